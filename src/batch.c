@@ -0,0 +1,423 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "chip8.h"
+#include "libchip8.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define BATCH_MAX_REWARDS 8
+
+typedef struct {
+    uint16_t addr;
+    uint8_t bytes;
+    float weight;
+} reward_term_t;
+
+struct chip8_batch_t {
+    chip8_t *env;                       //count machines, never moved once initialised
+    uint32_t *score;                    //Each environment's reward terms at its last step
+    uint32_t count;
+    chip8_t boot;                       //The ROM as loaded, environments reset to it
+
+    uint8_t factor;
+    chip8_batch_layout_t layout;
+    reward_term_t reward[BATCH_MAX_REWARDS];
+    uint8_t rewards;
+
+    //The job every thread is working on
+    const uint16_t *actions;
+    uint32_t frames;
+    uint8_t *buffer;
+    bool reset;
+
+    uint32_t threads;
+#ifndef _WIN32
+    pthread_t *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t finished;
+    uint64_t generation;                //Bumped once per job
+    uint32_t pending;                   //Workers still busy with it
+    bool quit;
+#endif
+};
+
+typedef struct {
+    chip8_batch_t *batch;
+    uint32_t index;
+} batch_worker_t;
+
+static void update_layout(chip8_batch_t *batch)
+{
+    chip8_batch_layout_t *layout = &batch->layout;
+    const uint16_t width = batch->env[0].mod.CHIP ? SCREEN_WIDTH : SCREEN_WIDTH_S;
+    const uint16_t height = batch->env[0].mod.CHIP ? SCREEN_HEIGHT : SCREEN_HEIGHT_S;
+
+    layout->width = width / batch->factor;
+    layout->height = height / batch->factor;
+    layout->obs = 0;
+    layout->reward = ((size_t)batch->count * layout->width * layout->height + 3) & ~(size_t)3;
+    layout->done = layout->reward + (size_t)batch->count * sizeof(float);
+    layout->size = layout->done + batch->count;
+}
+
+//Reward terms read as one big-endian number, so multi-byte scores work
+static uint32_t read_term(const chip8_t *chip8, const reward_term_t *term)
+{
+    uint32_t value = 0;
+
+    for (uint8_t i = 0; i < term->bytes; i++)
+    {
+        value = (value << 8) | ram_read(chip8, (term->addr + i) & (RAM_SIZE - 1));
+    }
+
+    return value;
+}
+
+static float collect_reward(chip8_batch_t *batch, uint32_t index)
+{
+    const chip8_t *chip8 = &batch->env[index];
+    uint32_t *score = &batch->score[index * BATCH_MAX_REWARDS];
+    float reward = 0.0f;
+
+    for (uint8_t t = 0; t < batch->rewards; t++)
+    {
+        const uint32_t value = read_term(chip8, &batch->reward[t]);
+
+        reward += batch->reward[t].weight * ((float)value - (float)score[t]);
+        score[t] = value;
+    }
+
+    return reward;
+}
+
+//Each cell is the share of lit screen pixels under it, 0-255. A SCHIP lo-res
+//surface is read as if doubled, like gfx_output does
+static void observe(const chip8_batch_t *batch, const chip8_t *chip8, uint8_t *out)
+{
+    const uint8_t factor = batch->factor;
+    const bool doubled = !chip8->mod.CHIP && gfx_lores(chip8);
+    const uint16_t src_width = gfx_lores(chip8) ? SCREEN_WIDTH : SCREEN_WIDTH_S;
+    const uint16_t area = factor * factor;
+
+    for (uint16_t oy = 0; oy < batch->layout.height; oy++)
+    {
+        for (uint16_t ox = 0; ox < batch->layout.width; ox++)
+        {
+            uint16_t lit = 0;
+
+            for (uint8_t y = 0; y < factor; y++)
+            {
+                const uint16_t sy = (oy * factor + y) >> doubled;
+                const uint8_t *row = &chip8->gfx[sy * src_width];
+
+                for (uint8_t x = 0; x < factor; x++)
+                {
+                    lit += row[(ox * factor + x) >> doubled] != 0;
+                }
+            }
+
+            *out++ = (uint8_t)(lit * 255 / area);
+        }
+    }
+}
+
+//Environments [begin, end) of the current job, straight into the caller's buffer
+static void run_range(chip8_batch_t *batch, uint32_t begin, uint32_t end)
+{
+    const chip8_batch_layout_t *layout = &batch->layout;
+    const size_t obs_size = (size_t)layout->width * layout->height;
+    float *rewards = (float *)(batch->buffer + layout->reward);
+    uint8_t *done = batch->buffer + layout->done;
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        chip8_t *chip8 = &batch->env[i];
+
+        if (batch->reset || chip8_halted(chip8))
+        {
+            //Copies back only what the episode wrote; the RNG stream carries on
+            const uint32_t rng = chip8->rng;
+
+            system_reset(chip8, &batch->boot);
+            chip8->rng = rng;
+            collect_reward(batch, i);
+        }
+
+        if (!batch->reset)
+        {
+            chip8_set_keys(chip8, batch->actions[i]);
+            for (uint32_t f = 0; f < batch->frames && !chip8_halted(chip8); f++)
+            {
+                chip8_step_frame(chip8);
+            }
+        }
+
+        observe(batch, chip8, batch->buffer + layout->obs + i * obs_size);
+        rewards[i] = batch->reset ? 0.0f : collect_reward(batch, i);
+        done[i] = chip8_halted(chip8);
+    }
+}
+
+static void run_slice(chip8_batch_t *batch, uint32_t index)
+{
+    const uint32_t begin = (uint32_t)((uint64_t)batch->count * index / batch->threads);
+    const uint32_t end = (uint32_t)((uint64_t)batch->count * (index + 1) / batch->threads);
+
+    run_range(batch, begin, end);
+}
+
+#ifndef _WIN32
+//Workers sleep between jobs; each takes the same contiguous slice every time
+static void *worker(void *data)
+{
+    batch_worker_t *self = data;
+    chip8_batch_t *batch = self->batch;
+    uint64_t seen = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->lock);
+        while (batch->generation == seen && !batch->quit)
+        {
+            pthread_cond_wait(&batch->start, &batch->lock);
+        }
+        if (batch->quit)
+        {
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+        seen = batch->generation;
+        pthread_mutex_unlock(&batch->lock);
+
+        run_slice(batch, self->index);
+
+        pthread_mutex_lock(&batch->lock);
+        if (--batch->pending == 0)
+        {
+            pthread_cond_signal(&batch->finished);
+        }
+        pthread_mutex_unlock(&batch->lock);
+    }
+
+    free(self);
+    return NULL;
+}
+
+static bool start_pool(chip8_batch_t *batch)
+{
+    batch->pool = calloc(batch->threads, sizeof(pthread_t));
+    if (batch->pool == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->start, NULL);
+    pthread_cond_init(&batch->finished, NULL);
+
+    //Slot 0 is the calling thread
+    for (uint32_t t = 1; t < batch->threads; t++)
+    {
+        batch_worker_t *self = malloc(sizeof(batch_worker_t));
+        if (self == NULL)
+        {
+            batch->threads = t;
+            break;
+        }
+
+        self->batch = batch;
+        self->index = t;
+        if (pthread_create(&batch->pool[t], NULL, worker, self) != 0)
+        {
+            free(self);
+            batch->threads = t;
+            break;
+        }
+    }
+
+    return true;
+}
+
+static void stop_pool(chip8_batch_t *batch)
+{
+    pthread_mutex_lock(&batch->lock);
+    batch->quit = true;
+    pthread_cond_broadcast(&batch->start);
+    pthread_mutex_unlock(&batch->lock);
+
+    for (uint32_t t = 1; t < batch->threads; t++)
+    {
+        pthread_join(batch->pool[t], NULL);
+    }
+
+    pthread_cond_destroy(&batch->finished);
+    pthread_cond_destroy(&batch->start);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch->pool);
+}
+#endif
+
+static void run_job(chip8_batch_t *batch, const uint16_t *actions, uint32_t frames, void *buffer, bool reset)
+{
+    batch->actions = actions;
+    batch->frames = frames;
+    batch->buffer = buffer;
+    batch->reset = reset;
+
+#ifndef _WIN32
+    if (batch->threads > 1)
+    {
+        pthread_mutex_lock(&batch->lock);
+        batch->pending = batch->threads - 1;
+        batch->generation++;
+        pthread_cond_broadcast(&batch->start);
+        pthread_mutex_unlock(&batch->lock);
+
+        run_slice(batch, 0);
+
+        pthread_mutex_lock(&batch->lock);
+        while (batch->pending > 0)
+        {
+            pthread_cond_wait(&batch->finished, &batch->lock);
+        }
+        pthread_mutex_unlock(&batch->lock);
+        return;
+    }
+#endif
+
+    run_range(batch, 0, batch->count);
+}
+
+chip8_batch_t *chip8_batch_create(const char *mod, const uint8_t *rom, size_t size,
+                                  uint32_t count, uint32_t seed, uint32_t threads)
+{
+    if (count == 0)
+    {
+        return NULL;
+    }
+
+    chip8_batch_t *batch = calloc(1, sizeof(chip8_batch_t));
+    if (batch == NULL)
+    {
+        return NULL;
+    }
+
+    batch->env = calloc(count, sizeof(chip8_t));
+    batch->score = calloc((size_t)count * BATCH_MAX_REWARDS, sizeof(uint32_t));
+    if (batch->env == NULL || batch->score == NULL)
+    {
+        free(batch->score);
+        free(batch->env);
+        free(batch);
+        return NULL;
+    }
+
+    batch->factor = 1;
+    if (!system_init(&batch->boot, mod) || !chip8_load(&batch->boot, rom, size))
+    {
+        chip8_batch_destroy(batch);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!system_init(&batch->env[i], mod) || !chip8_load(&batch->env[i], rom, size))
+        {
+            batch->count = i + 1;
+            chip8_batch_destroy(batch);
+            return NULL;
+        }
+        seed_rng(&batch->env[i], seed + i);
+        batch->count = i + 1;
+    }
+
+#ifdef _WIN32
+    //No thread pool here; callers wanting parallelism split the batch themselves
+    (void)threads;
+    batch->threads = 1;
+#else
+    if (threads == 0)
+    {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    batch->threads = threads < count ? threads : count;
+
+    if (batch->threads > 1 && !start_pool(batch))
+    {
+        batch->threads = 1;
+    }
+#endif
+
+    update_layout(batch);
+    return batch;
+}
+
+void chip8_batch_destroy(chip8_batch_t *batch)
+{
+#ifndef _WIN32
+    if (batch->threads > 1)
+    {
+        stop_pool(batch);
+    }
+#endif
+
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        system_release(&batch->env[i]);
+    }
+
+    system_release(&batch->boot);
+    free(batch->score);
+    free(batch->env);
+    free(batch);
+}
+
+bool chip8_batch_downsample(chip8_batch_t *batch, uint8_t factor)
+{
+    if (factor == 0 || factor > 8 || (factor & (factor - 1)) != 0)
+    {
+        fprintf(stderr, "Error downsample factor must be 1, 2, 4 or 8\n");
+        return false;
+    }
+
+    batch->factor = factor;
+    update_layout(batch);
+    return true;
+}
+
+bool chip8_batch_reward(chip8_batch_t *batch, uint16_t addr, uint8_t bytes, float weight)
+{
+    if (batch->rewards == BATCH_MAX_REWARDS || bytes == 0 || bytes > 4 || addr >= RAM_SIZE)
+    {
+        fprintf(stderr, "Error bad reward term or more than %d of them\n", BATCH_MAX_REWARDS);
+        return false;
+    }
+
+    batch->reward[batch->rewards++] = (reward_term_t){addr, bytes, weight};
+    return true;
+}
+
+void chip8_batch_layout(const chip8_batch_t *batch, chip8_batch_layout_t *layout)
+{
+    *layout = batch->layout;
+}
+
+chip8_t *chip8_batch_env(chip8_batch_t *batch, uint32_t index)
+{
+    return index < batch->count ? &batch->env[index] : NULL;
+}
+
+void chip8_batch_reset(chip8_batch_t *batch, void *buffer)
+{
+    run_job(batch, NULL, 0, buffer, true);
+}
+
+void chip8_batch_step(chip8_batch_t *batch, const uint16_t *actions, uint32_t frames, void *buffer)
+{
+    run_job(batch, actions, frames, buffer, false);
+}
@@ -0,0 +1,359 @@
+#include "capture.h"
+
+//CRC-32 (polynomial 0xEDB88320) of every byte value, precomputed so png_write
+//needs no setup and can run on several regress worker threads at once
+static const uint32_t crc_table[256] = {
+    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
+    0xE963A535, 0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
+    0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
+    0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+    0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9,
+    0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
+    0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
+    0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+    0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
+    0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
+    0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D, 0x76DC4190, 0x01DB7106,
+    0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+    0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D,
+    0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
+    0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
+    0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+    0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7,
+    0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
+    0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA,
+    0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+    0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
+    0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
+    0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84,
+    0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+    0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB,
+    0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
+    0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
+    0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55,
+    0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
+    0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28,
+    0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+    0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
+    0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
+    0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
+    0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+    0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69,
+    0x616BFFD3, 0x166CCF45, 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
+    0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
+    0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+    0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693,
+    0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
+    0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+};
+
+static uint32_t crc_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void put_u32(uint8_t *out, uint32_t v)
+{
+    out[0] = v >> 24;
+    out[1] = v >> 16;
+    out[2] = v >> 8;
+    out[3] = v;
+}
+
+static void png_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t word[4];
+
+    put_u32(word, len);
+    fwrite(word, 4, 1, file);
+    fwrite(type, 4, 1, file);
+    if (len > 0)
+    {
+        fwrite(data, len, 1, file);
+    }
+
+    uint32_t crc = crc_update(0xFFFFFFFF, (const uint8_t *)type, 4);
+    crc = crc_update(crc, data, len) ^ 0xFFFFFFFF;
+    put_u32(word, crc);
+    fwrite(word, 4, 1, file);
+}
+
+//Writes 0/1 pixels as a 1-bit greyscale PNG. The zlib stream uses stored blocks,
+//at one bit per pixel that is already small and keeps the encoder trivial.
+bool png_write(const char *path, const uint8_t *pixels, uint16_t width, uint16_t height)
+{
+    const uint32_t stride = 1 + (width + 7) / 8;
+    const uint32_t raw_size = stride * height;
+    const uint32_t blocks = (raw_size + 65534) / 65535;
+    uint8_t *idat = calloc(2 + raw_size + blocks * 5 + 4, 1);
+    uint8_t *raw = calloc(raw_size, 1);
+    if (idat == NULL || raw == NULL)
+    {
+        free(idat);
+        free(raw);
+        return false;
+    }
+
+    for (uint16_t y = 0; y < height; y++)
+    {
+        uint8_t *row = &raw[y * stride];
+        row[0] = 0;     //Filter type None
+        for (uint16_t x = 0; x < width; x++)
+        {
+            if (pixels[y * width + x])
+            {
+                row[1 + x / 8] |= 0x80 >> (x % 8);
+            }
+        }
+    }
+
+    uint32_t pos = 0;
+    idat[pos++] = 0x78;
+    idat[pos++] = 0x01;
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (uint32_t i = 0; i < raw_size; i++)
+    {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    for (uint32_t done = 0; done < raw_size;)
+    {
+        const uint16_t len = (raw_size - done > 65535) ? 65535 : raw_size - done;
+        idat[pos++] = (done + len == raw_size) ? 1 : 0;
+        idat[pos++] = len & 0xFF;
+        idat[pos++] = len >> 8;
+        idat[pos++] = ~len & 0xFF;
+        idat[pos++] = (~len >> 8) & 0xFF;
+        memcpy(&idat[pos], &raw[done], len);
+        pos += len;
+        done += len;
+    }
+    put_u32(&idat[pos], (b << 16) | a);
+    pos += 4;
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file: %s\n", path);
+        free(idat);
+        free(raw);
+        return false;
+    }
+
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    uint8_t ihdr[13] = {0};
+    put_u32(&ihdr[0], width);
+    put_u32(&ihdr[4], height);
+    ihdr[8] = 1;        //Bit depth
+    ihdr[9] = 0;        //Greyscale
+
+    fwrite(signature, sizeof(signature), 1, file);
+    png_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+    png_chunk(file, "IDAT", idat, pos);
+    png_chunk(file, "IEND", NULL, 0);
+
+    const bool ok = (ferror(file) == 0);
+    fclose(file);
+    free(idat);
+    free(raw);
+
+    return ok;
+}
+
+static void upscale(capture_t *cap, const uint8_t *gfx, uint8_t on)
+{
+    const uint16_t out_width = cap->width * cap->scale;
+
+    for (uint16_t y = 0; y < cap->height; y++)
+    {
+        uint8_t *row = &cap->scaled[y * cap->scale * out_width];
+
+        for (uint16_t x = 0; x < cap->width; x++)
+        {
+            memset(&row[x * cap->scale], gfx[y * cap->width + x] ? on : 0, cap->scale);
+        }
+
+        for (uint8_t s = 1; s < cap->scale; s++)
+        {
+            memcpy(&row[s * out_width], row, out_width);
+        }
+    }
+}
+
+static void encode(capture_t *cap, const capture_frame_t *entry)
+{
+    const uint16_t out_width = cap->width * cap->scale;
+    const uint16_t out_height = cap->height * cap->scale;
+
+    if (cap->format == CAPTURE_Y4M)
+    {
+        //Upscaled once per run, repeats only cost the write
+        upscale(cap, entry->gfx, 255);
+        for (uint32_t r = 0; r < entry->repeat; r++)
+        {
+            fputs("FRAME\n", cap->file);
+            fwrite(cap->scaled, (size_t)out_width * out_height, 1, cap->file);
+        }
+    }
+    else
+    {
+        //One file per run, named after its first frame; gaps in the numbering are repeats
+        char name[FILENAME_MAX];
+        snprintf(name, sizeof(name), "%s%06llu.png", cap->path, (unsigned long long)entry->frame);
+        upscale(cap, entry->gfx, 1);
+        png_write(name, cap->scaled, out_width, out_height);
+    }
+}
+
+static int capture_thread(void *data)
+{
+    capture_t *cap = data;
+    static capture_frame_t entry;
+
+    for (;;)
+    {
+        SDL_LockMutex(cap->lock);
+        while (cap->count == 0 && !cap->closing)
+        {
+            SDL_CondWait(cap->not_empty, cap->lock);
+        }
+
+        if (cap->count == 0)
+        {
+            SDL_UnlockMutex(cap->lock);
+            break;
+        }
+
+        entry = cap->queue[cap->head];
+        cap->head = (cap->head + 1) % CAPTURE_QUEUE_SIZE;
+        cap->count--;
+        SDL_CondSignal(cap->not_full);
+        SDL_UnlockMutex(cap->lock);
+
+        encode(cap, &entry);
+    }
+
+    return 0;
+}
+
+static void enqueue(capture_t *cap, const capture_frame_t *entry)
+{
+    SDL_LockMutex(cap->lock);
+    while (cap->count == CAPTURE_QUEUE_SIZE)
+    {
+        SDL_CondWait(cap->not_full, cap->lock);
+    }
+
+    cap->queue[cap->tail] = *entry;
+    cap->tail = (cap->tail + 1) % CAPTURE_QUEUE_SIZE;
+    cap->count++;
+    SDL_CondSignal(cap->not_empty);
+    SDL_UnlockMutex(cap->lock);
+}
+
+capture_t *capture_open(const char *path, const chip8_t *chip8, uint8_t scale, bool dedup)
+{
+    capture_t *cap = calloc(1, sizeof(capture_t));
+    if (cap == NULL)
+    {
+        fprintf(stderr, "Error allocating capture buffers\n");
+        return NULL;
+    }
+
+    const size_t len = strlen(path);
+    cap->format = (len > 4 && strcmp(&path[len - 4], ".y4m") == 0) ? CAPTURE_Y4M : CAPTURE_PNG;
+    cap->path = path;
+    cap->width = (chip8->mod.CHIP) ? SCREEN_WIDTH : SCREEN_WIDTH_S;
+    cap->height = (chip8->mod.CHIP) ? SCREEN_HEIGHT : SCREEN_HEIGHT_S;
+    cap->scale = scale ? scale : 1;
+    cap->dedup = dedup;
+    cap->scaled = malloc((size_t)cap->width * cap->scale * cap->height * cap->scale);
+
+    if (cap->scaled == NULL)
+    {
+        fprintf(stderr, "Error allocating capture buffers\n");
+        free(cap);
+        return NULL;
+    }
+
+    if (cap->format == CAPTURE_Y4M)
+    {
+        cap->file = fopen(path, "wb");
+        if (cap->file == NULL)
+        {
+            fprintf(stderr, "Error opening file: %s\n", path);
+            free(cap->scaled);
+            free(cap);
+            return NULL;
+        }
+
+        fprintf(cap->file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 Cmono\n",
+                cap->width * cap->scale, cap->height * cap->scale);
+    }
+
+    cap->lock = SDL_CreateMutex();
+    cap->not_empty = SDL_CreateCond();
+    cap->not_full = SDL_CreateCond();
+    cap->thread = SDL_CreateThread(capture_thread, "capture", cap);
+
+    return cap;
+}
+
+void capture_frame(capture_t *cap, const chip8_t *chip8)
+{
+    const size_t size = (size_t)cap->width * cap->height;
+    uint8_t gfx[SCREEN_WIDTH_S * SCREEN_HEIGHT_S];
+
+    gfx_output(chip8, gfx);
+
+    if (cap->frames > 0 && cap->dedup && memcmp(cap->pending.gfx, gfx, size) == 0)
+    {
+        cap->pending.repeat++;
+    }
+    else
+    {
+        if (cap->frames > 0)
+        {
+            enqueue(cap, &cap->pending);
+        }
+
+        memcpy(cap->pending.gfx, gfx, size);
+        cap->pending.repeat = 1;
+        cap->pending.frame = cap->frames;
+    }
+
+    cap->frames++;
+}
+
+void capture_close(capture_t *cap)
+{
+    if (cap->frames > 0)
+    {
+        enqueue(cap, &cap->pending);
+    }
+
+    SDL_LockMutex(cap->lock);
+    cap->closing = true;
+    SDL_CondSignal(cap->not_empty);
+    SDL_UnlockMutex(cap->lock);
+    SDL_WaitThread(cap->thread, NULL);
+
+    if (cap->file != NULL)
+    {
+        fclose(cap->file);
+    }
+
+    SDL_DestroyCond(cap->not_full);
+    SDL_DestroyCond(cap->not_empty);
+    SDL_DestroyMutex(cap->lock);
+    free(cap->scaled);
+    free(cap);
+}
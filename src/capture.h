@@ -0,0 +1,50 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "chip8.h"
+#include <SDL2/SDL.h>
+
+#define CAPTURE_QUEUE_SIZE 64
+
+typedef enum {
+    CAPTURE_Y4M,
+    CAPTURE_PNG
+} capture_format_t;
+
+typedef struct {
+    uint8_t gfx[SCREEN_WIDTH_S * SCREEN_HEIGHT_S];
+    uint32_t repeat;                //Identical frames this entry stands for
+    uint64_t frame;                 //Index of the first of them
+} capture_frame_t;
+
+typedef struct {
+    capture_format_t format;
+    const char *path;               //Y4M file, or prefix for numbered PNG files
+    FILE *file;
+    uint16_t width;                 //Emulated screen size
+    uint16_t height;
+    uint8_t scale;
+    bool dedup;
+    uint8_t *scaled;                //Upscaled frame, reused while a run repeats
+
+    //Bounded queue between the emulation thread and the encoder thread
+    capture_frame_t queue[CAPTURE_QUEUE_SIZE];
+    uint16_t head;
+    uint16_t tail;
+    uint16_t count;
+    bool closing;
+    SDL_mutex *lock;
+    SDL_cond *not_empty;
+    SDL_cond *not_full;
+    SDL_Thread *thread;
+
+    capture_frame_t pending;        //Run being collected before it is queued
+    uint64_t frames;
+} capture_t;
+
+capture_t *capture_open(const char *path, const chip8_t *chip8, uint8_t scale, bool dedup);
+void capture_frame(capture_t *cap, const chip8_t *chip8);
+void capture_close(capture_t *cap);
+bool png_write(const char *path, const uint8_t *pixels, uint16_t width, uint16_t height);
+
+#endif
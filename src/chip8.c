@@ -1,35 +1,182 @@
 #include "chip8.h"
 
-void load_rom(chip8_t *chip8, const char *rom_name)
+#ifdef CHIP8_PAGED_RAM
+//One font + ROM memory image, shared by every instance that loaded it
+struct ram_image_t {
+    ram_image_t *next;
+    uint64_t hash;
+    uint32_t refs;
+    uint8_t data[RAM_SIZE];
+};
+
+static ram_image_t *images;
+static bool images_lock;
+
+static void lock_images(void)
+{
+    while (__atomic_test_and_set(&images_lock, __ATOMIC_ACQUIRE))
+    {
+    }
+}
+
+static void unlock_images(void)
+{
+    __atomic_clear(&images_lock, __ATOMIC_RELEASE);
+}
+
+//Drops the private pages and the reference to the shared image
+void system_release(chip8_t *chip8)
+{
+    for (uint8_t p = 0; p < RAM_PAGES; p++)
+    {
+        if (chip8->owned & (1u << p))
+        {
+            free(chip8->page[p]);
+        }
+    }
+    chip8->owned = 0;
+
+    if (chip8->image != NULL)
+    {
+        lock_images();
+        if (--chip8->image->refs == 0)
+        {
+            ram_image_t **link = &images;
+            while (*link != chip8->image)
+            {
+                link = &(*link)->next;
+            }
+            *link = chip8->image->next;
+            free(chip8->image);
+        }
+        unlock_images();
+        chip8->image = NULL;
+    }
+}
+
+//Points every page at the shared image holding contents, creating it if no
+//other instance has loaded the same memory yet
+static bool ram_attach(chip8_t *chip8, const uint8_t *contents)
+{
+    uint64_t hash = 0xCBF29CE484222325;
+    for (uint16_t i = 0; i < RAM_SIZE; i++)
+    {
+        hash = (hash ^ contents[i]) * 0x100000001B3;
+    }
+
+    lock_images();
+    ram_image_t *image = images;
+    while (image != NULL && (image->hash != hash || memcmp(image->data, contents, RAM_SIZE) != 0))
+    {
+        image = image->next;
+    }
+
+    if (image == NULL)
+    {
+        image = malloc(sizeof(ram_image_t));
+        if (image == NULL)
+        {
+            unlock_images();
+            fprintf(stderr, "Error allocating memory image\n");
+            return false;
+        }
+        memcpy(image->data, contents, RAM_SIZE);
+        image->hash = hash;
+        image->refs = 0;
+        image->next = images;
+        images = image;
+    }
+    image->refs++;
+    unlock_images();
+
+    system_release(chip8);
+    chip8->image = image;
+    for (uint8_t p = 0; p < RAM_PAGES; p++)
+    {
+        chip8->page[p] = &image->data[p * RAM_PAGE_SIZE];
+    }
+
+    return true;
+}
+
+//Copy-on-write: the first store to a shared page gives this instance its own
+bool ram_own_page(chip8_t *chip8, uint8_t page)
+{
+    uint8_t *copy = malloc(RAM_PAGE_SIZE);
+    if (copy == NULL)
+    {
+        fprintf(stderr, "Error allocating RAM page\n");
+        chip8->state = QUIT;
+        return false;
+    }
+
+    memcpy(copy, chip8->page[page], RAM_PAGE_SIZE);
+    chip8->page[page] = copy;
+    chip8->owned |= 1u << page;
+    return true;
+}
+#else
+void system_release(chip8_t *chip8)
+{
+    (void)chip8;
+}
+#endif
+
+bool load_rom(chip8_t *chip8, const char *rom_name)
 {
     FILE *rom = fopen(rom_name, "rb");
     if (rom == NULL)
     {
         fprintf(stderr, "Error opening file: %s\n", rom_name);
-        exit(EXIT_FAILURE);
+        return false;
     }
 
     fseek(rom, 0, SEEK_END);
-    uint16_t rom_size = ftell(rom);
-    if (rom_size > RAM_SIZE - START_ADDRESS)
+    const long rom_size = ftell(rom);
+    if (rom_size < 0 || rom_size > RAM_SIZE - START_ADDRESS)
     {
         fprintf(stderr, "Error %s too big, available size up to 3584 bytes\n", rom_name);
         fclose(rom);
-        exit(EXIT_FAILURE);
+        return false;
     }
     rewind(rom);
 
-    if (fread(&chip8->ram[START_ADDRESS], rom_size, 1, rom) != 1)
+    uint8_t buffer[RAM_SIZE - START_ADDRESS];
+    if (rom_size > 0 && fread(buffer, rom_size, 1, rom) != 1)
     {
-        fprintf(stderr, "Error reading rom: %s, size: %d\n", rom_name, rom_size);
+        fprintf(stderr, "Error reading rom: %s, size: %ld\n", rom_name, rom_size);
         fclose(rom);
-        exit(EXIT_FAILURE);
+        return false;
     }
 
     fclose(rom);
+    return load_rom_buffer(chip8, buffer, rom_size);
+}
+
+bool load_rom_buffer(chip8_t *chip8, const uint8_t *rom, size_t size)
+{
+    if (size > RAM_SIZE - START_ADDRESS)
+    {
+        fprintf(stderr, "Error rom too big, available size up to 3584 bytes\n");
+        return false;
+    }
+
+#ifdef CHIP8_PAGED_RAM
+    uint8_t contents[RAM_SIZE];
+    for (uint16_t i = 0; i < RAM_SIZE; i++)
+    {
+        contents[i] = ram_read(chip8, i);
+    }
+    memcpy(&contents[START_ADDRESS], rom, size);
+    return ram_attach(chip8, contents);
+#else
+    memcpy(&chip8->ram[START_ADDRESS], rom, size);
+    system_mark_dirty(chip8);
+    return true;
+#endif
 }
 
-void system_init(chip8_t *chip8, const char *mod)    
+bool system_init(chip8_t *chip8, const char *mod)
 {
     const uint8_t font[] = {
         //Standard 8x5 font
@@ -63,10 +210,24 @@ void system_init(chip8_t *chip8, const char *mod)
         0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C   // 9
     };
 
+#ifdef CHIP8_PAGED_RAM
+    //chip8 must be zeroed or initialized before its first system_init
+    uint8_t contents[RAM_SIZE] = {0};
+    system_release(chip8);
+    memset(chip8, 0, sizeof(chip8_t));
+    memcpy(&contents[FONT_START], font, sizeof(font));
+    if (!ram_attach(chip8, contents))
+    {
+        return false;
+    }
+#else
     memset(chip8, 0, sizeof(chip8_t));
     memcpy(&chip8->ram[FONT_START], font, sizeof(font));
+#endif
     chip8->PC = START_ADDRESS;
     chip8->state = RUNNING;
+    seed_rng(chip8, (uint32_t)rand());
+    system_mark_dirty(chip8);
 
     if (strcmp(mod, "-s") == 0)
     {
@@ -87,67 +248,162 @@ void system_init(chip8_t *chip8, const char *mod)
         printf("[-s] for SUPERCHIP, ");
         printf("[-xo] for XOCHIP\n");
         printf("If you don't wanna use them, don't set any flag\n");
-        SDL_Quit();
-        exit(EXIT_FAILURE);
+        return false;
+    }
+
+    select_engine(chip8);
+    chip8->timer_cycles = inst_per_frame(chip8);
+    return true;
+}
+
+//Copies the blocks set in dirty, one memcpy per run of neighbouring blocks
+static void copy_dirty(uint8_t *dst, const uint8_t *src, uint32_t dirty, uint8_t shift)
+{
+    while (dirty)
+    {
+        const uint8_t first = (uint8_t)__builtin_ctz(dirty);
+        const uint8_t run = (uint8_t)__builtin_ctzll(~((uint64_t)dirty >> first));
+
+        memcpy(&dst[(size_t)first << shift], &src[(size_t)first << shift], (size_t)run << shift);
+        dirty &= ~(uint32_t)((((uint64_t)1 << run) - 1) << first);
     }
 }
 
-void keyboard(chip8_t *chip8, const char *mod, const char *rom_file)
+//Puts chip8 back to boot, a copy taken right after it was loaded, copying only
+//the RAM pages and gfx blocks written since. The dirty bits are relative to the
+//boot chip8 was last reset to or copied from; resetting to a different image
+//needs system_mark_dirty first
+void system_reset(chip8_t *chip8, const chip8_t *boot)
 {
-    SDL_Event event;
+    copy_dirty(chip8->gfx, boot->gfx, chip8->gfx_dirty, GFX_BLOCK_SHIFT);
 
-    while (SDL_PollEvent(&event))
+    //Everything but RAM and gfx is registers and timers, taken whole
+#ifdef CHIP8_PAGED_RAM
+    memcpy(chip8, boot, offsetof(chip8_t, page));
+#else
+    copy_dirty(chip8->ram, boot->ram, chip8->ram_dirty, RAM_PAGE_SHIFT);
+    memcpy(chip8, boot, offsetof(chip8_t, ram));
+    chip8->ram_dirty = 0;
+#endif
+    memcpy(&chip8->stack, &boot->stack, offsetof(chip8_t, gfx) - offsetof(chip8_t, stack));
+    memcpy(&chip8->delay_timer, &boot->delay_timer, sizeof(chip8_t) - offsetof(chip8_t, delay_timer));
+    chip8->gfx_dirty = 0;
+
+#ifdef CHIP8_PAGED_RAM
+    //The written pages are private copies already: refill them from boot's,
+    //so a reset allocates nothing. Last, so a failed allocation's QUIT stays
+    if (chip8->image != boot->image)
     {
-        if (event.type == SDL_KEYDOWN)
+        uint8_t contents[RAM_SIZE];
+        for (uint16_t i = 0; i < RAM_SIZE; i++)
         {
-            switch (event.key.keysym.sym)
-            {
-            case SDLK_ESCAPE:
-                chip8->state = QUIT;
-                break;
-
-            case SDL_QUIT:
-                chip8->state = QUIT;
-                break;
-            
-            case SDLK_SPACE:
-                if (chip8->state == PAUSED)
-                {
-                    chip8->state = RUNNING;
-                }
-                else
-                {
-                    chip8->state = PAUSED;
-                }
-                break;
-
-            case SDLK_LALT:
-                system_init(chip8, mod);
-                load_rom(chip8, rom_file);
-                break;
-
-            default:
-                break;
-            }
+            contents[i] = ram_read(boot, i);
         }
+        if (!ram_attach(chip8, contents))
+        {
+            chip8->state = QUIT;
+        }
+        return;
+    }
 
-        for (uint8_t i = 0; i < NUM_KEYS; i++)
+    for (uint8_t p = 0; p < RAM_PAGES; p++)
+    {
+        if ((chip8->owned | boot->owned) & (1u << p))
         {
-            if (event.key.keysym.sym == keyboard_map[i])
+            if (!(chip8->owned & (1u << p)) && !ram_own_page(chip8, p))
             {
-                chip8->keyboard[i] = true;
+                return;
             }
+            memcpy(chip8->page[p], boot->page[p], RAM_PAGE_SIZE);
         }
+    }
+#endif
+}
+
+//Makes the next system_reset copy everything, for a machine whose RAM or gfx
+//was changed around ram_write and gfx_touch
+void system_mark_dirty(chip8_t *chip8)
+{
+#ifndef CHIP8_PAGED_RAM
+    chip8->ram_dirty = (uint16_t)((1u << RAM_PAGES) - 1);
+#endif
+    chip8->gfx_dirty = UINT32_MAX;
+}
+
+void seed_rng(chip8_t *chip8, uint32_t seed)
+{
+    //Xorshift never leaves the zero state, so fold zero onto a fixed constant
+    chip8->rng = seed ? seed : 0x2545F491;
+}
 
-        if (event.type == SDL_KEYUP)
+//Picks the interpreter core for the current variant and resolution. Called at
+//init and whenever 00FE/00FF change hr, never per instruction
+void select_engine(chip8_t *chip8)
+{
+    if (chip8->mod.SUPERCHIP)
+    {
+        chip8->engine = chip8->hr.HiRes ? ENGINE_SCHIP_HIRES : ENGINE_SCHIP_LORES;
+    }
+    else if (chip8->mod.XOCHIP)
+    {
+        chip8->engine = ENGINE_XOCHIP;
+    }
+    else
+    {
+        chip8->engine = ENGINE_CHIP8;
+    }
+}
+
+//True while gfx holds a 64x32 surface: always for CHIP-8, and in SCHIP lo-res
+bool gfx_lores(const chip8_t *chip8)
+{
+    return chip8->mod.CHIP || (chip8->mod.SUPERCHIP && !chip8->hr.HiRes);
+}
+
+//Copies the screen at the variant's output size (64x32 for CHIP-8, 128x64
+//otherwise), doubling the SCHIP lo-res surface on the way
+void gfx_output(const chip8_t *chip8, uint8_t *out)
+{
+    if (chip8->mod.CHIP || !gfx_lores(chip8))
+    {
+        memcpy(out, chip8->gfx, sizeof(chip8->gfx));
+        return;
+    }
+
+    for (uint8_t y = 0; y < SCREEN_HEIGHT; y++)
+    {
+        for (uint8_t x = 0; x < SCREEN_WIDTH; x++)
         {
-            for (uint8_t i = 0; i < NUM_KEYS; i++)
-            {
-                if (event.key.keysym.sym == keyboard_map[i])
-                {
-                    chip8->keyboard[i] = false;
-                }
-            }
+            const uint8_t pixel = chip8->gfx[y * SCREEN_WIDTH + x];
+            uint8_t *dst = &out[2 * y * SCREEN_WIDTH_S + 2 * x];
+
+            dst[0] = dst[1] = pixel;
+            dst[SCREEN_WIDTH_S] = dst[SCREEN_WIDTH_S + 1] = pixel;
         }
     }
-}
\ No newline at end of file
+}
+
+uint16_t inst_per_frame(const chip8_t *chip8)
+{
+    uint16_t inst_per_sec = chip8->mod.CHIP ? 700 : 1200;
+    return inst_per_sec / 60;
+}
+
+void tick_timers(chip8_t *chip8)
+{
+    if (chip8->delay_timer > 0)
+    {
+        chip8->delay_timer--;
+    }
+
+    if (chip8->sound_timer > 0)
+    {
+        chip8->sound_timer--;
+    }
+}
+
+//One 60 Hz frame of emulated time, without any host pacing
+void run_frame(chip8_t *chip8)
+{
+    run_instructions(chip8, inst_per_frame(chip8));
+}
@@ -1,11 +1,14 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
 #include <stdint.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <time.h>
 #include <stdbool.h>
-#include <unistd.h>
-#include <SDL2/SDL.h>
+#include <string.h>
 
 #define TIMER_MAX 255
 #define WINDOW_WIDTH 1280
@@ -14,12 +17,15 @@
 #define SCREEN_HEIGHT 32
 #define SCREEN_WIDTH_S 128
 #define SCREEN_HEIGHT_S 64
-#define SCALE 20
-#define SCALE_S 10
 #define NUM_REGS 16
 #define NUM_RPL 8
-#define STACK_SIZE 12
+#define STACK_SIZE 16
 #define RAM_SIZE 4096
+#define RAM_MASK (RAM_SIZE - 1)
+#define RAM_PAGE_SHIFT 8
+#define RAM_PAGE_SIZE (1 << RAM_PAGE_SHIFT)
+#define RAM_PAGES (RAM_SIZE / RAM_PAGE_SIZE)
+#define GFX_BLOCK_SHIFT 8
 #define START_ADDRESS 512
 #define FONT_START 80
 #define EXTENDED_FONT_START 160
@@ -41,6 +47,13 @@ typedef struct {
     bool HiRes;
 } chip8_hires_t;
 
+typedef enum {
+    ENGINE_CHIP8,
+    ENGINE_SCHIP_LORES,
+    ENGINE_SCHIP_HIRES,
+    ENGINE_XOCHIP
+} chip8_engine_t;
+
 typedef struct {
     uint16_t opcode;
     uint16_t NNN;
@@ -50,12 +63,28 @@ typedef struct {
     uint8_t Y;
 } instruction_t;
 
+#ifdef CHIP8_PAGED_RAM
+typedef struct ram_image_t ram_image_t;
+#endif
+
 typedef struct chip8_t {
     chip8_state_t state;
     chip8_mods_t mod;
     instruction_t inst;
     chip8_hires_t hr;
+    chip8_engine_t engine;          //Specialized core for mod + hr, see select_engine
+#ifdef CHIP8_PAGED_RAM
+    //Built into libchip8: RAM is a page table over a font + ROM image shared by
+    //every instance that loaded the same ROM. A page is copied on its first
+    //write, so an instance only owns the pages it has stored to. Instances
+    //must not be copied by value in this layout
+    uint8_t *page[RAM_PAGES];
+    uint16_t owned;                 //Bit per page that is a private copy
+    ram_image_t *image;
+#else
     uint8_t ram[RAM_SIZE];
+    uint16_t ram_dirty;             //Bit per page stored to since the last reset
+#endif
     uint16_t stack[STACK_SIZE];
     uint8_t V[NUM_REGS];            //(0 - 14), carry flag (15)
     uint8_t RPL[NUM_RPL];           //Additional general-purpose registers similar to the V
@@ -63,36 +92,70 @@ typedef struct chip8_t {
     uint16_t PC;                    
     uint8_t SP;                 
     uint8_t gfx[SCREEN_WIDTH_S * SCREEN_HEIGHT_S];
+    uint32_t gfx_dirty;             //Bit per 256 bytes of gfx drawn to since the last reset
     uint8_t delay_timer;
     uint8_t sound_timer;
+    uint16_t timer_cycles;          //Instructions left until the next 60 Hz timer tick
+    uint32_t rng;                   //Xorshift state for CXNN, seeded per instance
     bool keyboard[NUM_KEYS];
     bool key_pressed;
     bool wait_to_key;
     bool draw_flag;
 } chip8_t;
 
-static const uint8_t keyboard_map[NUM_KEYS] = {
-    SDLK_x, // 0
-    SDLK_1, // 1
-    SDLK_2, // 2
-    SDLK_3, // 3
-    SDLK_q, // 4
-    SDLK_w, // 5
-    SDLK_e, // 6
-    SDLK_a, // 7
-    SDLK_s, // 8
-    SDLK_d, // 9
-    SDLK_z, // A
-    SDLK_c, // B
-    SDLK_4, // C
-    SDLK_r, // D
-    SDLK_f, // E
-    SDLK_v  // F
-};
-
-void load_rom(chip8_t *chip8, const char *rom_name);
-void system_init(chip8_t *chip8, const char *mod);
-void keyboard(chip8_t *chip8, const char *mod, const char *rom_file);
+#ifdef CHIP8_PAGED_RAM
+bool ram_own_page(chip8_t *chip8, uint8_t page);
+#endif
+
+//All core RAM access goes through these; addr is already masked
+static inline uint8_t ram_read(const chip8_t *chip8, uint16_t addr)
+{
+#ifdef CHIP8_PAGED_RAM
+    return chip8->page[addr >> RAM_PAGE_SHIFT][addr & (RAM_PAGE_SIZE - 1)];
+#else
+    return chip8->ram[addr];
+#endif
+}
+
+static inline void ram_write(chip8_t *chip8, uint16_t addr, uint8_t value)
+{
+#ifdef CHIP8_PAGED_RAM
+    const uint8_t page = addr >> RAM_PAGE_SHIFT;
+
+    if (!(chip8->owned & (1u << page)) && !ram_own_page(chip8, page))
+    {
+        return;
+    }
+    chip8->page[page][addr & (RAM_PAGE_SIZE - 1)] = value;
+#else
+    chip8->ram[addr] = value;
+    chip8->ram_dirty |= 1u << (addr >> RAM_PAGE_SHIFT);
+#endif
+}
+
+//Row of gfx about to be drawn to, for system_reset
+static inline void gfx_touch(chip8_t *chip8, const uint8_t *row)
+{
+    chip8->gfx_dirty |= 1u << ((row - chip8->gfx) >> GFX_BLOCK_SHIFT);
+}
+
+bool load_rom(chip8_t *chip8, const char *rom_name);
+bool load_rom_buffer(chip8_t *chip8, const uint8_t *rom, size_t size);
+bool system_init(chip8_t *chip8, const char *mod);
+void system_release(chip8_t *chip8);
+void system_reset(chip8_t *chip8, const chip8_t *boot);
+void system_mark_dirty(chip8_t *chip8);
+void seed_rng(chip8_t *chip8, uint32_t seed);
+void select_engine(chip8_t *chip8);
+bool gfx_lores(const chip8_t *chip8);
+void gfx_output(const chip8_t *chip8, uint8_t *out);
+uint16_t inst_per_frame(const chip8_t *chip8);
+void tick_timers(chip8_t *chip8);
+void run_frame(chip8_t *chip8);
+void run_instructions(chip8_t *chip8, uint32_t count);
 void instruction_execution(chip8_t *chip8);
 void db_instruction_execution(chip8_t *chip8);
-void handle_undef_inst(chip8_t *chip8);
\ No newline at end of file
+void handle_undef_inst(chip8_t *chip8);
+void handle_stack_fault(chip8_t *chip8, const char *what);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+
+//chip8-server control protocol, spoken over a Unix-domain stream socket.
+//Every connection drives its own machine.
+//
+//    request:  u8 op,     u32 length, length bytes of payload
+//    response: u8 status, u32 length, length bytes of payload
+//
+//All integers little-endian. Responses come back in request order, one per
+//request, so a client can pipeline requests and read the answers as they
+//arrive. The server stops reading from a client that has 256 KiB of answers
+//it hasn't taken, so a client must not block sending while it has unread
+//answers: send a window of requests, then read, or do both at once. A
+//malformed header closes the connection.
+
+#define CTL_HEADER_SIZE 5
+#define CTL_MAX_PAYLOAD 16384
+#define CTL_STATE_MAGIC 0x54533843      //"C8ST"
+
+typedef enum {
+    CTL_LOAD = 1,       //u8 variant (0 CHIP-8, 1 SUPERCHIP, 2 XO-CHIP), u32 seed, ROM bytes
+    CTL_RESET,          //[u32 seed]: reload the ROM, with the LOAD seed unless one is given
+    CTL_KEYS,           //u16 keypad mask, bit n for key n
+    CTL_RUN,            //u32 frames -> u32 frames run, u8 state (0 halted, 1 running)
+    CTL_SAVE,           //-> state blob, only meaningful to the same chip8-server build
+    CTL_RESTORE,        //state blob from CTL_SAVE
+    CTL_REGS,           //-> u16 PC, u16 I, u8 SP, u8 DT, u8 ST, u8 hires, V0-VF, 16 x u16 stack
+    CTL_RAM,            //u16 addr, u16 length (up to 4096, wraps) -> bytes
+    CTL_FRAME           //-> u8 width, u8 height, one byte per pixel (0/1) at the current surface size
+} ctl_op_t;
+
+typedef enum {
+    CTL_OK,
+    CTL_BAD_REQUEST,    //Unknown op or wrong payload length
+    CTL_NO_ROM,         //Needs a CTL_LOAD first
+    CTL_FAILED          //ROM too big, bad variant, state blob that doesn't fit
+} ctl_status_t;
+
+#endif
@@ -0,0 +1,537 @@
+#include <ctype.h>
+#include <signal.h>
+#include <string.h>
+#include "debugger.h"
+#include "disasm.h"
+
+//Interactive debugger. The frame loop only calls debugger_run while something
+//is armed (a breakpoint, a watchpoint, a pending step or a Ctrl-C break-in);
+//otherwise it stays on the specialized run_instructions loop. debugger_run
+//only reports a stop; the caller prompts once it has let go of the machine.
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+static void rebuild_break_map(debugger_t *db)
+{
+    memset(db->break_map, 0, sizeof(db->break_map));
+
+    for (uint8_t i = 0; i < db->num_breaks; i++)
+    {
+        const uint16_t addr = db->breaks[i].addr;
+        db->break_map[addr >> 3] |= 1 << (addr & 7);
+    }
+}
+
+void debugger_init(debugger_t *db)
+{
+    memset(db, 0, sizeof(debugger_t));
+    db->step = true;                    //Start at the prompt
+
+    //Replaces SDL's handler, which would turn Ctrl-C into SDL_QUIT
+    signal(SIGINT, on_interrupt);
+}
+
+bool debugger_armed(const debugger_t *db)
+{
+    return db->num_breaks || db->num_watches || db->step || db->step_over || db->resume || interrupted;
+}
+
+static uint16_t cond_value(const chip8_t *chip8, uint8_t reg)
+{
+    return (reg == 0x10) ? chip8->I : chip8->V[reg];
+}
+
+static bool cond_holds(const breakpoint_t *bp, const chip8_t *chip8)
+{
+    const uint16_t value = cond_value(chip8, bp->reg);
+
+    switch (bp->op)
+    {
+        case COND_EQ: return value == bp->value;
+        case COND_NE: return value != bp->value;
+        case COND_LT: return value < bp->value;
+        case COND_LE: return value <= bp->value;
+        case COND_GT: return value > bp->value;
+        case COND_GE: return value >= bp->value;
+        default: return true;
+    }
+}
+
+//RAM bytes the instruction at PC is about to touch, starting at I
+static uint8_t access_length(const chip8_t *chip8, uint16_t opcode, bool *write)
+{
+    const uint8_t X = (opcode >> 8) & 0x0F;
+
+    *write = false;
+
+    if ((opcode & 0xF000) == 0xD000)
+    {
+        const uint8_t N = opcode & 0x000F;
+        return (N == 0 && chip8->mod.SUPERCHIP && chip8->hr.HiRes) ? 32 : N;
+    }
+
+    switch (opcode & 0xF0FF)
+    {
+        case 0xF033:
+            *write = true;
+            return 3;
+
+        case 0xF055:
+            *write = true;
+            return X + 1;
+
+        case 0xF065:
+            return X + 1;
+
+        default:
+            return 0;
+    }
+}
+
+static int8_t watch_hit(const debugger_t *db, const chip8_t *chip8, uint16_t opcode, uint16_t *hit_addr)
+{
+    bool write;
+    const uint8_t len = access_length(chip8, opcode, &write);
+
+    for (uint8_t k = 0; k < len; k++)
+    {
+        const uint16_t addr = (chip8->I + k) & RAM_MASK;
+
+        for (uint8_t w = 0; w < db->num_watches; w++)
+        {
+            const watchpoint_t *wp = &db->watches[w];
+
+            if (addr >= wp->start && addr <= wp->end && (write ? wp->write : wp->read))
+            {
+                *hit_addr = addr;
+                return w;
+            }
+        }
+    }
+
+    return -1;
+}
+
+//Why execution should stop before the instruction at PC, or NULL to run it
+static const char *stop_reason(debugger_t *db, const chip8_t *chip8)
+{
+    static char reason[64];
+    const uint16_t pc = chip8->PC & RAM_MASK;
+
+    if (interrupted)
+    {
+        interrupted = 0;
+        return "Interrupted";
+    }
+
+    if (db->step)
+    {
+        return "Step";
+    }
+
+    if (db->step_over && pc == db->over_pc && chip8->SP == db->over_sp)
+    {
+        return "Step";
+    }
+
+    if (db->break_map[pc >> 3] & (1 << (pc & 7)))
+    {
+        for (uint8_t i = 0; i < db->num_breaks; i++)
+        {
+            if (db->breaks[i].addr == pc && cond_holds(&db->breaks[i], chip8))
+            {
+                snprintf(reason, sizeof(reason), "Breakpoint %u", i);
+                return reason;
+            }
+        }
+    }
+
+    if (db->num_watches)
+    {
+        const uint16_t opcode = (chip8->ram[pc] << 8) | chip8->ram[(pc + 1) & RAM_MASK];
+        uint16_t addr;
+        const int8_t w = watch_hit(db, chip8, opcode, &addr);
+
+        if (w >= 0)
+        {
+            snprintf(reason, sizeof(reason), "Watchpoint %d at 0x%03X", w, addr);
+            return reason;
+        }
+    }
+
+    return NULL;
+}
+
+//Runs up to count instructions. Returns why it stopped before the instruction
+//at PC, leaving the rest of the batch unrun, or NULL once the batch is done
+const char *debugger_run(debugger_t *db, chip8_t *chip8, uint16_t count)
+{
+    for (uint16_t i = 0; i < count && chip8->state != QUIT; i++)
+    {
+        const char *reason = db->resume ? NULL : stop_reason(db, chip8);
+
+        db->resume = false;
+        if (reason != NULL)
+        {
+            return reason;
+        }
+
+        run_instructions(chip8, 1);
+
+        //Everything was disarmed at the prompt, finish the batch at full speed
+        if (!debugger_armed(db))
+        {
+            run_instructions(chip8, count - i - 1);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void print_state(const chip8_t *chip8)
+{
+    char text[32];
+
+    printf("PC %03X  I %03X  SP %u  DT %02X  ST %02X\n",
+           chip8->PC, chip8->I, chip8->SP, chip8->delay_timer, chip8->sound_timer);
+
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        printf("V%X %02X%s", i, chip8->V[i], (i % 8 == 7) ? "\n" : "  ");
+    }
+
+    printf("Stack:");
+    for (uint8_t i = 1; i <= chip8->SP && i < STACK_SIZE; i++)    //Pushes pre-increment SP, slot 0 is never used
+    {
+        printf(" %03X", chip8->stack[i]);
+    }
+    printf("\n");
+
+    const uint16_t pc = chip8->PC & RAM_MASK;
+    const uint16_t first = (pc >= 6) ? pc - 6 : pc & 1;
+
+    for (uint16_t addr = first; addr <= pc + 10 && addr < RAM_SIZE - 1; addr += 2)
+    {
+        const uint16_t opcode = (chip8->ram[addr] << 8) | chip8->ram[addr + 1];
+
+        disassemble(opcode, text, sizeof(text));
+        printf("%s %03X  %04X  %s\n", (addr == pc) ? "=>" : "  ", addr, opcode, text);
+    }
+}
+
+static void print_points(const debugger_t *db)
+{
+    static const char *const ops[] = {"", "==", "!=", "<", "<=", ">", ">="};
+
+    for (uint8_t i = 0; i < db->num_breaks; i++)
+    {
+        const breakpoint_t *bp = &db->breaks[i];
+
+        printf("b%-2u %03X", i, bp->addr);
+        if (bp->op != COND_NONE)
+        {
+            if (bp->reg == 0x10)
+            {
+                printf("  if I %s 0x%X", ops[bp->op], bp->value);
+            }
+            else
+            {
+                printf("  if V%X %s 0x%X", bp->reg, ops[bp->op], bp->value);
+            }
+        }
+        printf("\n");
+    }
+
+    for (uint8_t i = 0; i < db->num_watches; i++)
+    {
+        const watchpoint_t *wp = &db->watches[i];
+        printf("w%-2u %03X-%03X %s%s\n", i, wp->start, wp->end, wp->read ? "r" : "", wp->write ? "w" : "");
+    }
+}
+
+static void print_help(void)
+{
+    printf("c                     Continue\n");
+    printf("s                     Step one instruction\n");
+    printf("n                     Step, running a 2NNN call to its return\n");
+    printf("b <addr> [cond]       Break at addr, optionally when e.g. V3==5 or I>=0x300\n");
+    printf("w <addr>[-end] [rw]   Watch reads (r), writes (w) or both of a RAM range\n");
+    printf("d <n> / dw <n>        Delete breakpoint / watchpoint n\n");
+    printf("i                     List breakpoints and watchpoints\n");
+    printf("x <addr> [len]        Dump RAM\n");
+    printf("r                     Show registers, stack and disassembly\n");
+    printf("q                     Quit the emulator\n");
+}
+
+static bool parse_cond(const char *text, breakpoint_t *bp)
+{
+    static const struct { const char *str; cond_op_t op; } ops[] = {
+        {"==", COND_EQ}, {"!=", COND_NE}, {"<=", COND_LE}, {">=", COND_GE}, {"<", COND_LT}, {">", COND_GT}
+    };
+    char compact[32] = {0};
+    uint8_t len = 0;
+
+    for (; *text && len < sizeof(compact) - 1; text++)
+    {
+        if (*text != ' ' && *text != '\t' && *text != '\n')
+        {
+            compact[len++] = *text;
+        }
+    }
+
+    if (len == 0)
+    {
+        bp->op = COND_NONE;
+        return true;
+    }
+
+    const char *p = compact;
+    if (*p == 'I' || *p == 'i')
+    {
+        bp->reg = 0x10;
+        p++;
+    }
+    else if ((*p == 'V' || *p == 'v') && isxdigit((unsigned char)p[1]))
+    {
+        const char digit[2] = {p[1], '\0'};
+        bp->reg = (uint8_t)strtoul(digit, NULL, 16);
+        p += 2;
+    }
+    else
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        const size_t op_len = strlen(ops[i].str);
+
+        if (strncmp(p, ops[i].str, op_len) == 0)
+        {
+            char *end;
+
+            bp->op = ops[i].op;
+            bp->value = (uint16_t)strtoul(p + op_len, &end, 0);
+            return end != p + op_len && *end == '\0';
+        }
+    }
+
+    return false;
+}
+
+static void add_breakpoint(debugger_t *db, const char *args)
+{
+    char *rest;
+    breakpoint_t bp = {0};
+
+    bp.addr = (uint16_t)strtoul(args, &rest, 0) & RAM_MASK;
+    if (rest == args || !parse_cond(rest, &bp))
+    {
+        printf("Usage: b <addr> [V0-VF|I ==|!=|<|<=|>|>= value]\n");
+        return;
+    }
+
+    if (db->num_breaks >= MAX_BREAKPOINTS)
+    {
+        printf("Too many breakpoints\n");
+        return;
+    }
+
+    db->breaks[db->num_breaks++] = bp;
+    rebuild_break_map(db);
+}
+
+static void add_watchpoint(debugger_t *db, const char *args)
+{
+    char *rest;
+    char mode[4] = "rw";
+    watchpoint_t wp = {0};
+
+    wp.start = (uint16_t)strtoul(args, &rest, 0) & RAM_MASK;
+    if (rest == args)
+    {
+        printf("Usage: w <addr>[-end] [r|w|rw]\n");
+        return;
+    }
+
+    wp.end = wp.start;
+    if (*rest == '-')
+    {
+        wp.end = (uint16_t)strtoul(rest + 1, &rest, 0) & RAM_MASK;
+    }
+    sscanf(rest, "%3s", mode);
+
+    wp.read = strchr(mode, 'r') != NULL;
+    wp.write = strchr(mode, 'w') != NULL;
+
+    if (wp.end < wp.start || (!wp.read && !wp.write))
+    {
+        printf("Usage: w <addr>[-end] [r|w|rw]\n");
+        return;
+    }
+
+    if (db->num_watches >= MAX_WATCHPOINTS)
+    {
+        printf("Too many watchpoints\n");
+        return;
+    }
+
+    db->watches[db->num_watches++] = wp;
+}
+
+static void delete_point(debugger_t *db, const char *args, bool watch)
+{
+    const unsigned long n = strtoul(args, NULL, 10);
+
+    if (watch && n < db->num_watches)
+    {
+        memmove(&db->watches[n], &db->watches[n + 1], (db->num_watches - n - 1) * sizeof(watchpoint_t));
+        db->num_watches--;
+    }
+    else if (!watch && n < db->num_breaks)
+    {
+        memmove(&db->breaks[n], &db->breaks[n + 1], (db->num_breaks - n - 1) * sizeof(breakpoint_t));
+        db->num_breaks--;
+        rebuild_break_map(db);
+    }
+    else
+    {
+        printf("No such %s\n", watch ? "watchpoint" : "breakpoint");
+    }
+}
+
+static void dump_ram(const chip8_t *chip8, const char *args)
+{
+    char *rest;
+    const uint16_t start = (uint16_t)strtoul(args, &rest, 0) & RAM_MASK;
+    unsigned long len = strtoul(rest, NULL, 0);
+
+    if (len == 0)
+    {
+        len = 16;
+    }
+
+    for (unsigned long i = 0; i < len && start + i < RAM_SIZE; i++)
+    {
+        if (i % 16 == 0)
+        {
+            printf("%s%03lX:", i ? "\n" : "", start + i);
+        }
+        printf(" %02X", chip8->ram[start + i]);
+    }
+    printf("\n");
+}
+
+//Blocks on stdin until a command resumes execution; false when the user quits.
+//chip8 is only read, so it can be a copy taken while the machine was locked
+bool debugger_prompt(debugger_t *db, const chip8_t *chip8, const char *reason)
+{
+    char line[128];
+
+    db->step = false;
+    db->step_over = false;
+
+    printf("\n%s\n", reason);
+    print_state(chip8);
+
+    for (;;)
+    {
+        char cmd[8] = {0};
+        int offset = 0;
+
+        printf("(chip8) ");
+        fflush(stdout);
+
+        //No terminal attached (or Ctrl-D): disarm everything, or every later
+        //hit would stop here again and return straight away
+        if (fgets(line, sizeof(line), stdin) == NULL)
+        {
+            db->num_breaks = 0;
+            db->num_watches = 0;
+            db->step_over = false;
+            rebuild_break_map(db);
+            printf("\nEnd of input, breakpoints and watchpoints cleared\n");
+            db->resume = true;
+            return true;
+        }
+
+        if (sscanf(line, "%7s%n", cmd, &offset) != 1)
+        {
+            continue;
+        }
+
+        const char *args = line + offset;
+
+        if (strcmp(cmd, "c") == 0)
+        {
+            db->resume = true;
+            return true;
+        }
+        else if (strcmp(cmd, "s") == 0)
+        {
+            db->step = true;
+            db->resume = true;
+            return true;
+        }
+        else if (strcmp(cmd, "n") == 0)
+        {
+            const uint16_t pc = chip8->PC & RAM_MASK;
+
+            if ((chip8->ram[pc] & 0xF0) == 0x20)
+            {
+                db->step_over = true;
+                db->over_pc = (pc + 2) & RAM_MASK;
+                db->over_sp = chip8->SP;
+            }
+            else
+            {
+                db->step = true;
+            }
+            db->resume = true;
+            return true;
+        }
+        else if (strcmp(cmd, "b") == 0)
+        {
+            add_breakpoint(db, args);
+        }
+        else if (strcmp(cmd, "w") == 0)
+        {
+            add_watchpoint(db, args);
+        }
+        else if (strcmp(cmd, "d") == 0)
+        {
+            delete_point(db, args, false);
+        }
+        else if (strcmp(cmd, "dw") == 0)
+        {
+            delete_point(db, args, true);
+        }
+        else if (strcmp(cmd, "i") == 0)
+        {
+            print_points(db);
+        }
+        else if (strcmp(cmd, "x") == 0)
+        {
+            dump_ram(chip8, args);
+        }
+        else if (strcmp(cmd, "r") == 0)
+        {
+            print_state(chip8);
+        }
+        else if (strcmp(cmd, "q") == 0)
+        {
+            return false;
+        }
+        else
+        {
+            print_help();
+        }
+    }
+}
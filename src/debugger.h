@@ -0,0 +1,51 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "chip8.h"
+
+#define MAX_BREAKPOINTS 32
+#define MAX_WATCHPOINTS 16
+
+typedef enum {
+    COND_NONE,
+    COND_EQ,
+    COND_NE,
+    COND_LT,
+    COND_LE,
+    COND_GT,
+    COND_GE
+} cond_op_t;
+
+typedef struct {
+    uint16_t addr;
+    cond_op_t op;
+    uint8_t reg;                    //0x0-0xF for V0-VF, 0x10 for I
+    uint16_t value;
+} breakpoint_t;
+
+typedef struct {
+    uint16_t start;
+    uint16_t end;                   //Inclusive
+    bool read;
+    bool write;
+} watchpoint_t;
+
+typedef struct {
+    breakpoint_t breaks[MAX_BREAKPOINTS];
+    watchpoint_t watches[MAX_WATCHPOINTS];
+    uint8_t num_breaks;
+    uint8_t num_watches;
+    uint8_t break_map[RAM_SIZE / 8];    //One bit per address with a breakpoint on it
+    bool step;                          //Stop before the next instruction
+    bool step_over;                     //Stop once PC returns to over_pc at depth over_sp
+    uint16_t over_pc;
+    uint8_t over_sp;
+    bool resume;                        //Run the instruction the prompt stopped at without checking it again
+} debugger_t;
+
+void debugger_init(debugger_t *db);
+bool debugger_armed(const debugger_t *db);
+const char *debugger_run(debugger_t *db, chip8_t *chip8, uint16_t count);
+bool debugger_prompt(debugger_t *db, const chip8_t *chip8, const char *reason);
+
+#endif
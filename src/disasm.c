@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include "disasm.h"
+
+//Writes the mnemonic for one opcode, in the usual Cowgod-style syntax
+void disassemble(uint16_t opcode, char *out, size_t size)
+{
+    const uint16_t NNN = opcode & 0x0FFF;
+    const uint8_t NN = opcode & 0x00FF;
+    const uint8_t N = opcode & 0x000F;
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t Y = (opcode >> 4) & 0x0F;
+
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+            if (opcode == 0x00E0)
+            {
+                snprintf(out, size, "CLS");
+            }
+            else if (opcode == 0x00EE)
+            {
+                snprintf(out, size, "RET");
+            }
+            else if ((opcode & 0xFFF0) == 0x00C0)
+            {
+                snprintf(out, size, "SCD %d", N);
+            }
+            else if (opcode == 0x00FB)
+            {
+                snprintf(out, size, "SCR");
+            }
+            else if (opcode == 0x00FC)
+            {
+                snprintf(out, size, "SCL");
+            }
+            else if (opcode == 0x00FD)
+            {
+                snprintf(out, size, "EXIT");
+            }
+            else if (opcode == 0x00FE)
+            {
+                snprintf(out, size, "LOW");
+            }
+            else if (opcode == 0x00FF)
+            {
+                snprintf(out, size, "HIGH");
+            }
+            else
+            {
+                snprintf(out, size, "DW 0x%04X", opcode);
+            }
+            break;
+
+        case 0x1000:
+            snprintf(out, size, "JP 0x%03X", NNN);
+            break;
+
+        case 0x2000:
+            snprintf(out, size, "CALL 0x%03X", NNN);
+            break;
+
+        case 0x3000:
+            snprintf(out, size, "SE V%X, 0x%02X", X, NN);
+            break;
+
+        case 0x4000:
+            snprintf(out, size, "SNE V%X, 0x%02X", X, NN);
+            break;
+
+        case 0x5000:
+            snprintf(out, size, "SE V%X, V%X", X, Y);
+            break;
+
+        case 0x6000:
+            snprintf(out, size, "LD V%X, 0x%02X", X, NN);
+            break;
+
+        case 0x7000:
+            snprintf(out, size, "ADD V%X, 0x%02X", X, NN);
+            break;
+
+        case 0x8000:
+        {
+            static const char *const alu[16] = {
+                "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL
+            };
+
+            if (alu[N] != NULL)
+            {
+                snprintf(out, size, "%s V%X, V%X", alu[N], X, Y);
+            }
+            else
+            {
+                snprintf(out, size, "DW 0x%04X", opcode);
+            }
+            break;
+        }
+
+        case 0x9000:
+            snprintf(out, size, "SNE V%X, V%X", X, Y);
+            break;
+
+        case 0xA000:
+            snprintf(out, size, "LD I, 0x%03X", NNN);
+            break;
+
+        case 0xB000:
+            snprintf(out, size, "JP V0, 0x%03X", NNN);
+            break;
+
+        case 0xC000:
+            snprintf(out, size, "RND V%X, 0x%02X", X, NN);
+            break;
+
+        case 0xD000:
+            snprintf(out, size, "DRW V%X, V%X, %d", X, Y, N);
+            break;
+
+        case 0xE000:
+            if (NN == 0x9E)
+            {
+                snprintf(out, size, "SKP V%X", X);
+            }
+            else if (NN == 0xA1)
+            {
+                snprintf(out, size, "SKNP V%X", X);
+            }
+            else
+            {
+                snprintf(out, size, "DW 0x%04X", opcode);
+            }
+            break;
+
+        case 0xF000:
+            switch (NN)
+            {
+                case 0x07: snprintf(out, size, "LD V%X, DT", X); break;
+                case 0x0A: snprintf(out, size, "LD V%X, K", X); break;
+                case 0x15: snprintf(out, size, "LD DT, V%X", X); break;
+                case 0x18: snprintf(out, size, "LD ST, V%X", X); break;
+                case 0x1E: snprintf(out, size, "ADD I, V%X", X); break;
+                case 0x29: snprintf(out, size, "LD F, V%X", X); break;
+                case 0x30: snprintf(out, size, "LD HF, V%X", X); break;
+                case 0x33: snprintf(out, size, "LD B, V%X", X); break;
+                case 0x55: snprintf(out, size, "LD [I], V%X", X); break;
+                case 0x65: snprintf(out, size, "LD V%X, [I]", X); break;
+                case 0x75: snprintf(out, size, "LD R, V%X", X); break;
+                case 0x85: snprintf(out, size, "LD V%X, R", X); break;
+                default: snprintf(out, size, "DW 0x%04X", opcode); break;
+            }
+            break;
+    }
+}
@@ -0,0 +1,9 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+void disassemble(uint16_t opcode, char *out, size_t size);
+
+#endif
@@ -0,0 +1,106 @@
+#include "chip8.h"
+
+//In-process fuzzing harness for the instruction core. Input layout:
+//
+//    byte 0      bits 0-1: variant (0 CHIP-8, 1 SUPERCHIP, 2 XO-CHIP, 3 CHIP-8)
+//    bytes 1-2   keypad mask held for the whole run
+//    bytes 3-6   RNG seed
+//    rest        ROM image, loaded at START_ADDRESS
+//
+//Build with 'make fuzz' (clang, libFuzzer + ASan/UBSan). The same entry point
+//works with AFL++ persistent mode through its libFuzzer driver. Without
+//libFuzzer, -DFUZZ_STANDALONE adds a main() that replays input files. The core
+//is built with CHIP8_QUIET: no diagnostics, and a run ends at the first
+//undefined opcode.
+
+#define FUZZ_HEADER 7
+#define FUZZ_BUDGET 4096
+
+static chip8_t templates[3];
+
+static void fuzz_init(void)
+{
+    static const char *const mods[3] = {"CHIP8", "-s", "-xo"};
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        system_init(&templates[i], mods[i]);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static bool ready = false;
+    static chip8_t chip8;
+
+    if (!ready)
+    {
+        fuzz_init();
+        chip8 = templates[0];
+        ready = true;
+    }
+
+    if (size < FUZZ_HEADER || size - FUZZ_HEADER > RAM_SIZE - START_ADDRESS)
+    {
+        return 0;
+    }
+
+    const uint8_t variant = (data[0] & 3) == 3 ? 0 : data[0] & 3;
+    const uint16_t keys = data[1] | (data[2] << 8);
+    const uint32_t seed = data[3] | (data[4] << 8) | (data[5] << 16) | ((uint32_t)data[6] << 24);
+
+    //Back to a pre-built image, copying only what the last input wrote, instead
+    //of system_init's memset, font copy and mode parsing. The templates differ
+    //in registers only, so any of them resets the RAM and gfx of another
+    system_reset(&chip8, &templates[variant]);
+    if (size > FUZZ_HEADER)
+    {
+        const uint16_t end = START_ADDRESS + (uint16_t)(size - FUZZ_HEADER);
+
+        memcpy(&chip8.ram[START_ADDRESS], &data[FUZZ_HEADER], size - FUZZ_HEADER);
+        for (uint16_t page = START_ADDRESS >> RAM_PAGE_SHIFT; page <= (end - 1) >> RAM_PAGE_SHIFT; page++)
+        {
+            chip8.ram_dirty |= 1u << page;
+        }
+    }
+    seed_rng(&chip8, seed);
+
+    for (uint8_t i = 0; i < NUM_KEYS; i++)
+    {
+        chip8.keyboard[i] = (keys >> i) & 1;
+    }
+
+    for (uint32_t i = 0; i < FUZZ_BUDGET && chip8.state != QUIT; i++)
+    {
+        run_instructions(&chip8, 1);
+    }
+
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+int main(int argc, char const *argv[])
+{
+    static uint8_t buffer[FUZZ_HEADER + RAM_SIZE];
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL)
+        {
+            fprintf(stderr, "Error opening file: %s\n", argv[i]);
+            continue;
+        }
+
+        const size_t size = fread(buffer, 1, sizeof(buffer), file);
+        fclose(file);
+
+        LLVMFuzzerTestOneInput(buffer, size);
+        printf("Ran %s (%zu bytes)\n", argv[i], size);
+    }
+
+    return 0;
+}
+#endif
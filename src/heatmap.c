@@ -0,0 +1,143 @@
+#include "heatmap.h"
+
+heatmap_t heatmap;
+
+static const char *const kind_names[NUM_HEAT] = {"read", "written", "executed"};
+
+static inline uint32_t count_at(heat_kind_t kind, uint16_t addr)
+{
+    return __atomic_load_n(&heatmap.counts[kind][addr], __ATOMIC_RELAXED);
+}
+
+//Log scale by bit length, so an address touched once still shows next to a
+//loop executed millions of times
+static inline uint8_t bit_length(uint32_t value)
+{
+    return value ? 32 - __builtin_clz(value) : 0;
+}
+
+//One ARGB8888 pixel per address, HEATMAP_SIDE x HEATMAP_SIDE: red for
+//writes, green for reads, blue for executes, each against its own maximum
+void heatmap_render(uint32_t *out, size_t pitch)
+{
+    uint8_t peak[NUM_HEAT] = {0};
+
+    for (uint8_t k = 0; k < NUM_HEAT; k++)
+    {
+        for (uint16_t addr = 0; addr < RAM_SIZE; addr++)
+        {
+            const uint8_t bits = bit_length(count_at(k, addr));
+            peak[k] = bits > peak[k] ? bits : peak[k];
+        }
+    }
+
+    for (uint16_t addr = 0; addr < RAM_SIZE; addr++)
+    {
+        uint32_t *row = (uint32_t *)((uint8_t *)out + (addr / HEATMAP_SIDE) * pitch);
+        uint32_t colour = 0xFF000000;
+
+        for (uint8_t k = 0; k < NUM_HEAT; k++)
+        {
+            const uint32_t level = peak[k] ? bit_length(count_at(k, addr)) * 255 / peak[k] : 0;
+            colour |= level << (16 - 8 * k);
+        }
+
+        //Blue alone is hard to see on black
+        if ((colour & 0xFFFFFF) == (colour & 0xFF))
+        {
+            colour |= (colour & 0xFF) / 3 * 0x010100;
+        }
+
+        row[addr % HEATMAP_SIDE] = colour;
+    }
+}
+
+bool heatmap_write(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening heatmap file: %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "#addr reads writes executes\n");
+    for (uint16_t addr = 0; addr < RAM_SIZE; addr++)
+    {
+        const uint32_t reads = count_at(HEAT_READS, addr);
+        const uint32_t writes = count_at(HEAT_WRITES, addr);
+        const uint32_t execs = count_at(HEAT_EXECS, addr);
+
+        if (reads | writes | execs)
+        {
+            fprintf(file, "0x%03X %u %u %u\n", addr, reads, writes, execs);
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+//Prints up to 8 address ranges where every byte matches; true if there were any
+static bool print_ranges(FILE *out, bool (*match)(uint16_t))
+{
+    uint8_t ranges = 0;
+
+    for (uint16_t addr = 0; addr < RAM_SIZE && ranges < 8; addr++)
+    {
+        if (!match(addr))
+        {
+            continue;
+        }
+
+        const uint16_t first = addr;
+        while (addr + 1 < RAM_SIZE && match(addr + 1))
+        {
+            addr++;
+        }
+
+        fprintf(out, " 0x%03X-0x%03X", first, addr);
+        ranges++;
+    }
+
+    return ranges > 0;
+}
+
+static bool self_modified(uint16_t addr)
+{
+    return count_at(HEAT_WRITES, addr) > 0 && count_at(HEAT_EXECS, addr) > 0;
+}
+
+static bool data_read(uint16_t addr)
+{
+    return count_at(HEAT_READS, addr) > 0;
+}
+
+void heatmap_summary(FILE *out)
+{
+    fprintf(out, "Heatmap:");
+    for (uint8_t k = 0; k < NUM_HEAT; k++)
+    {
+        uint16_t touched = 0;
+        for (uint16_t addr = 0; addr < RAM_SIZE; addr++)
+        {
+            touched += count_at(k, addr) > 0;
+        }
+        fprintf(out, "%s %u bytes %s", k ? "," : "", touched, kind_names[k]);
+    }
+    fprintf(out, "\n");
+
+    fprintf(out, "  read (sprites, FX65):");
+    if (!print_ranges(out, data_read))
+    {
+        fprintf(out, " none");
+    }
+    fprintf(out, "\n");
+
+    fprintf(out, "  written and executed:");
+    if (!print_ranges(out, self_modified))
+    {
+        fprintf(out, " none, the ROM does not modify its code");
+    }
+    fprintf(out, "\n");
+}
@@ -0,0 +1,50 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "chip8.h"
+
+//Per-address read, write and execute counts over RAM, compiled in only with
+//-DCHIP8_HEATMAP ('make heatmap' builds chip8-heatmap). Without it every
+//HEAT_* macro below is empty.
+//
+//Counted paths: the instruction fetch (both opcode bytes), DXYN sprite reads,
+//FX65 reads and FX33/FX55 writes. Run-ahead frames count like any others.
+
+#define HEATMAP_SIDE 64                 //The overlay shows RAM as 64 rows of 64 bytes
+
+typedef enum {
+    HEAT_READS,
+    HEAT_WRITES,
+    HEAT_EXECS,
+    NUM_HEAT
+} heat_kind_t;
+
+//Only the emulation thread counts; the overlay reads along with it and may
+//see a count a step behind, never torn
+typedef struct {
+    uint32_t counts[NUM_HEAT][RAM_SIZE];
+} heatmap_t;
+
+#ifdef CHIP8_HEATMAP
+extern heatmap_t heatmap;
+
+static inline void heat_count(heat_kind_t kind, uint16_t addr)
+{
+    uint32_t *count = &heatmap.counts[kind][addr & RAM_MASK];
+    __atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
+}
+
+void heatmap_render(uint32_t *out, size_t pitch);
+bool heatmap_write(const char *path);
+void heatmap_summary(FILE *out);
+
+#define HEAT_READ(addr) heat_count(HEAT_READS, addr)
+#define HEAT_WRITE(addr) heat_count(HEAT_WRITES, addr)
+#define HEAT_EXEC(addr) heat_count(HEAT_EXECS, addr)
+#else
+#define HEAT_READ(addr)
+#define HEAT_WRITE(addr)
+#define HEAT_EXEC(addr)
+#endif
+
+#endif
@@ -1,7 +1,14 @@
 #include "chip8.h"
+#include "perfcount.h"
+#include "heatmap.h"
+#include "sprite.h"
 
 void handle_undef_inst(chip8_t *chip8)
 {
+#ifdef CHIP8_QUIET
+    //Fuzz builds: zeroed RAM decodes as 0x0000 forever, so stop instead of reporting it
+    chip8->state = QUIT;
+#else
     fprintf(stderr, "Error: Undefined instruction encountered.\n");
     fprintf(stderr, "Opcode: 0x%X\n", chip8->inst.opcode);
     fprintf(stderr, "Binary: ");
@@ -11,15 +18,84 @@ void handle_undef_inst(chip8_t *chip8)
     }
     fprintf(stderr, "\n");
     fprintf(stderr, "PC (Program Counter): 0x%X\n", chip8->PC);
+#endif
 }
 
-void instruction_execution(chip8_t *chip8)
+//Stack faults come from the ROM, not from the emulator, so stop it instead of aborting
+void handle_stack_fault(chip8_t *chip8, const char *what)
+{
+#ifndef CHIP8_QUIET
+    fprintf(stderr, "Error: Stack %s at PC: 0x%X, SP: %d\n", what, chip8->PC - 2, chip8->SP);
+#else
+    (void)what;
+#endif
+    chip8->state = QUIT;
+}
+
+//SCHIP keeps lo-res screens as a native 64x32 surface, so switching modes
+//converts the picture instead of reinterpreting the buffer
+static void gfx_to_hires(chip8_t *chip8)
 {
+    for (int16_t y = SCREEN_HEIGHT - 1; y >= 0; y--)
+    {
+        for (int16_t x = SCREEN_WIDTH - 1; x >= 0; x--)
+        {
+            const uint8_t pixel = chip8->gfx[y * SCREEN_WIDTH + x];
+            uint8_t *out = &chip8->gfx[2 * y * SCREEN_WIDTH_S + 2 * x];
+
+            out[0] = out[1] = pixel;
+            out[SCREEN_WIDTH_S] = out[SCREEN_WIDTH_S + 1] = pixel;
+        }
+    }
+    chip8->gfx_dirty = UINT32_MAX;
+}
+
+//A lo-res pixel is lit if any of its four hi-res pixels were, which is what
+//lo-res collisions used to test against
+static void gfx_to_lores(chip8_t *chip8)
+{
+    for (uint8_t y = 0; y < SCREEN_HEIGHT; y++)
+    {
+        for (uint8_t x = 0; x < SCREEN_WIDTH; x++)
+        {
+            const uint8_t *in = &chip8->gfx[2 * y * SCREEN_WIDTH_S + 2 * x];
+
+            chip8->gfx[y * SCREEN_WIDTH + x] = in[0] | in[1] | in[SCREEN_WIDTH_S] | in[SCREEN_WIDTH_S + 1];
+        }
+    }
+
+    memset(&chip8->gfx[SCREEN_WIDTH * SCREEN_HEIGHT], 0, sizeof(chip8->gfx) - SCREEN_WIDTH * SCREEN_HEIGHT);
+    chip8->gfx_dirty = UINT32_MAX;
+}
+
+static uint8_t next_random(chip8_t *chip8)
+{
+    uint32_t x = chip8->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip8->rng = x;
+
+    return x >> 24;
+}
+
+//The interpreter core. Every caller passes a constant engine, so each
+//specialization below gets its own copy with the quirk checks folded away
+static inline __attribute__((always_inline)) void execute(chip8_t *chip8, const chip8_engine_t engine)
+{
+    const bool chip = (engine == ENGINE_CHIP8);
+    const bool schip = (engine == ENGINE_SCHIP_LORES || engine == ENGINE_SCHIP_HIRES);
+    const bool hires = (engine == ENGINE_SCHIP_HIRES);
+    //CHIP-8 and XO-CHIP ROMs can still flip hr with 00FF, which only the scrolls look at
+    const bool scroll_hires = schip ? hires : chip8->hr.HiRes;
     bool carry_flag = false;
     uint8_t screen_height = 0;
     uint8_t screen_width = 0;
+    PERF_SAMPLE(perf);
 
-    chip8->inst.opcode = (chip8->ram[chip8->PC] << 8) | chip8->ram[chip8->PC + 1];
+    HEAT_EXEC(chip8->PC);
+    HEAT_EXEC(chip8->PC + 1);
+    chip8->inst.opcode = (ram_read(chip8, chip8->PC & RAM_MASK) << 8) | ram_read(chip8, (chip8->PC + 1) & RAM_MASK);
     chip8->PC += 2;
 
     switch (chip8->inst.opcode & 0xF000)
@@ -30,31 +106,47 @@ void instruction_execution(chip8_t *chip8)
                 //Opcode 00E0: Clear screen
                 case 0x00E0:
                     memset(&chip8->gfx, 0, sizeof(chip8->gfx));
+                    chip8->gfx_dirty = UINT32_MAX;
                     chip8->draw_flag = true;
                     break; 
 
                 //Opcode 00EE: Return from subroutine
                 case 0x00EE:
-                    assert(chip8->SP > 0);
+                    if (chip8->SP == 0)
+                    {
+                        handle_stack_fault(chip8, "underflow");
+                        break;
+                    }
                     chip8->PC = chip8->stack[chip8->SP--];
                     break;
 
                 //Opcode 00FF: Enable 128x64 high-resolution graphics mode
                 case 0x00FF:
+                    if (schip && !hires)
+                    {
+                        gfx_to_hires(chip8);
+                    }
                     chip8->hr.HiRes = true;
+                    select_engine(chip8);
                     break;
 
                 //Opcode 00FE: Disable high resolution graphics mode and return to 64x32
                 case 0x00FE:
+                    if (schip && hires)
+                    {
+                        gfx_to_lores(chip8);
+                    }
                     chip8->hr.HiRes = false;
+                    select_engine(chip8);
                     break;
 
                 //Opcode 00FB: Scroll the display right by 4 pixels
                 case 0x00FB:
                     chip8->inst.N = chip8->inst.opcode & 0x0F;
+                    PERF_BEGIN(perf);
 
-                    screen_height = chip8->hr.HiRes ? SCREEN_HEIGHT_S : SCREEN_HEIGHT;
-                    screen_width = chip8->hr.HiRes ? SCREEN_WIDTH_S : SCREEN_WIDTH;
+                    screen_height = scroll_hires ? SCREEN_HEIGHT_S : SCREEN_HEIGHT;
+                    screen_width = scroll_hires ? SCREEN_WIDTH_S : SCREEN_WIDTH;
 
                     for (uint8_t y = 0; y < screen_height; y++)
                     {
@@ -69,15 +161,18 @@ void instruction_execution(chip8_t *chip8)
                         }
                     }
 
+                    chip8->gfx_dirty = UINT32_MAX;
                     chip8->draw_flag = true;
+                    PERF_END(REGION_SCROLL, perf);
                     break;
 
                 //Opcode 00FC: Scroll the display left by 4 pixels
                 case 0x00FC:
                     chip8->inst.N = chip8->inst.opcode & 0x0F;
+                    PERF_BEGIN(perf);
 
-                    screen_height = chip8->hr.HiRes ? SCREEN_HEIGHT_S : SCREEN_HEIGHT;
-                    screen_width = chip8->hr.HiRes ? SCREEN_WIDTH_S : SCREEN_WIDTH;
+                    screen_height = scroll_hires ? SCREEN_HEIGHT_S : SCREEN_HEIGHT;
+                    screen_width = scroll_hires ? SCREEN_WIDTH_S : SCREEN_WIDTH;
 
                     for (uint8_t y = 0; y < screen_height; y++)
                     {
@@ -92,7 +187,9 @@ void instruction_execution(chip8_t *chip8)
                         }
                     }
 
+                    chip8->gfx_dirty = UINT32_MAX;
                     chip8->draw_flag = true;
+                    PERF_END(REGION_SCROLL, perf);
                     break;
 
                 //Opcode 00CN: Scroll the display down by 0 to 15 pixels
@@ -113,9 +210,10 @@ void instruction_execution(chip8_t *chip8)
                 case 0x00CE:
                 case 0x00CF:
                     chip8->inst.N = chip8->inst.opcode & 0x0F;
+                    PERF_BEGIN(perf);
 
-                    screen_height = chip8->hr.HiRes ? SCREEN_HEIGHT_S : SCREEN_HEIGHT;
-                    screen_width = chip8->hr.HiRes ? SCREEN_WIDTH_S : SCREEN_WIDTH;
+                    screen_height = scroll_hires ? SCREEN_HEIGHT_S : SCREEN_HEIGHT;
+                    screen_width = scroll_hires ? SCREEN_WIDTH_S : SCREEN_WIDTH;
 
                     for (int y = screen_height - 1; y >= chip8->inst.N; y--)
                     {
@@ -132,12 +230,16 @@ void instruction_execution(chip8_t *chip8)
                         }
                     }
 
+                    chip8->gfx_dirty = UINT32_MAX;
                     chip8->draw_flag = true;
+                    PERF_END(REGION_SCROLL, perf);
                     break;
 
                 //Opcode 00FD: Exit the interpreter (halt the program)
                 case 0x00FD:
+#ifndef CHIP8_QUIET
                     printf("EXIT\n");
+#endif
                     break;
 
                 default:
@@ -157,7 +259,11 @@ void instruction_execution(chip8_t *chip8)
         case 0x2000:
             chip8->inst.NNN = chip8->inst.opcode & 0x0FFF;
 
-            assert(chip8->SP < 15);
+            if (chip8->SP >= STACK_SIZE - 1)
+            {
+                handle_stack_fault(chip8, "overflow");
+                break;
+            }
             chip8->stack[++chip8->SP] = chip8->PC;
             chip8->PC = chip8->inst.NNN;
             break;
@@ -230,7 +336,7 @@ void instruction_execution(chip8_t *chip8)
                         
                     chip8->V[chip8->inst.X] |= chip8->V[chip8->inst.Y]; 
                     
-                    if (chip8->mod.CHIP == true)
+                    if (chip)
                     {
                         chip8->V[0xF] = 0;
                     }
@@ -243,7 +349,7 @@ void instruction_execution(chip8_t *chip8)
                         
                     chip8->V[chip8->inst.X] &= chip8->V[chip8->inst.Y]; 
                     
-                    if (chip8->mod.CHIP == true)
+                    if (chip)
                     {
                         chip8->V[0xF] = 0;
                     }
@@ -256,7 +362,7 @@ void instruction_execution(chip8_t *chip8)
                         
                     chip8->V[chip8->inst.X] ^= chip8->V[chip8->inst.Y];
 
-                    if (chip8->mod.CHIP == true)
+                    if (chip)
                     {
                         chip8->V[0xF] = 0;
                     }
@@ -290,12 +396,12 @@ void instruction_execution(chip8_t *chip8)
                     chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
                     chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
 
-                    if (chip8->mod.CHIP == true)
+                    if (chip)
                     {
                         carry_flag = chip8->V[chip8->inst.Y] & 1;
                         chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] >> 1;    
                     }
-                    else if (chip8->mod.SUPERCHIP == true)
+                    else if (schip)
                     {
                         carry_flag = chip8->V[chip8->inst.X] & 1;
                         chip8->V[chip8->inst.X] >>= 1;   
@@ -321,12 +427,12 @@ void instruction_execution(chip8_t *chip8)
                     chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
                     chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
                     
-                    if (chip8->mod.CHIP == true)
+                    if (chip)
                     {
                         carry_flag = (chip8->V[chip8->inst.Y] & 0x80) >> 7;
                         chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] << 1;    
                     }
-                    else if (chip8->mod.SUPERCHIP == true)
+                    else if (schip)
                     {
                         carry_flag = (chip8->V[chip8->inst.X] & 0x80) >> 7;
                         chip8->V[chip8->inst.X] <<= 1;    
@@ -364,11 +470,11 @@ void instruction_execution(chip8_t *chip8)
             chip8->inst.NNN = chip8->inst.opcode & 0x0FFF;
             chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
 
-            if (chip8->mod.CHIP == true)
+            if (chip)
             {
                 chip8->PC = chip8->V[0] + chip8->inst.NNN;
             }
-            else if (chip8->mod.SUPERCHIP == true)
+            else if (schip)
             {
                 chip8->PC = chip8->V[chip8->inst.X] + chip8->inst.NNN;   
             }
@@ -380,7 +486,7 @@ void instruction_execution(chip8_t *chip8)
             chip8->inst.NN = chip8->inst.opcode & 0x0FF;
             chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
 
-            chip8->V[chip8->inst.X] = (rand() % 256) & chip8->inst.NN;
+            chip8->V[chip8->inst.X] = next_random(chip8) & chip8->inst.NN;
             break;
 
         //Opcode DXYN: Draws a sprite at coordinate (VX, VY),
@@ -390,142 +496,83 @@ void instruction_execution(chip8_t *chip8)
             chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
             chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
             chip8->V[0xF] = 0;
+            PERF_BEGIN(perf);
             
-            if (chip8->mod.CHIP)
+            if (chip)
             {
-                uint8_t x_coord = chip8->V[chip8->inst.X] % SCREEN_WIDTH;
+                const uint8_t x_coord = chip8->V[chip8->inst.X] % SCREEN_WIDTH;
                 uint8_t y_coord = chip8->V[chip8->inst.Y] % SCREEN_HEIGHT;
-                const uint8_t original_x = x_coord;
 
-                for (uint8_t y = 0; y < chip8->inst.N; y++)
+                //Clipped at the right and bottom edges
+                for (uint8_t y = 0; y < chip8->inst.N && y_coord < SCREEN_HEIGHT; y++, y_coord++)
                 {
-                    const uint8_t pixel_data = chip8->ram[chip8->I + y];
-                    x_coord = original_x;
+                    HEAT_READ(chip8->I + y);
+                    const uint8_t pixel_data = ram_read(chip8, (chip8->I + y) & RAM_MASK);
+                    uint8_t *row = &chip8->gfx[y_coord * SCREEN_WIDTH];
 
-                    for (int8_t x = 7; x >= 0; x--)
+                    gfx_touch(chip8, row);
+                    if (draw_sprite_row(row, x_coord, SCREEN_WIDTH, pixel_data, false))
                     {
-                        uint8_t *pixel = &chip8->gfx[y_coord * SCREEN_WIDTH + x_coord];
-                        const uint8_t sprite_bit = (pixel_data & (1 << x)) != 0;    
-
-                        if (sprite_bit && *pixel)
-                        {
-                            chip8->V[0xF] = 1;
-                        }
-
-                        *pixel ^= sprite_bit;
-
-                        if (++x_coord >= SCREEN_WIDTH)
-                        {
-                            break;
-                        }
-                    }
-
-                    if (++y_coord >= SCREEN_HEIGHT)
-                    {
-                        break;
+                        chip8->V[0xF] = 1;
                     }
                 }
 
                 chip8->draw_flag = true;
             }
-            else if (chip8->mod.SUPERCHIP)
+            else if (schip)
             {
-                if (chip8->hr.HiRes && chip8->inst.N == 0)    //DXY0
+                //SCHIP wraps sprites around both edges
+                const uint8_t width = hires ? SCREEN_WIDTH_S : SCREEN_WIDTH;
+                const uint8_t height = hires ? SCREEN_HEIGHT_S : SCREEN_HEIGHT;
+
+                if (hires && chip8->inst.N == 0)    //DXY0, 16x16, placed once for the whole sprite
                 {
-                    uint8_t x_coord = chip8->V[chip8->inst.X];
-                    uint8_t y_coord = chip8->V[chip8->inst.Y];
+                    const uint8_t x_coord = chip8->V[chip8->inst.X] % width;
+                    const uint8_t y_coord = chip8->V[chip8->inst.Y];
 
                     for (uint8_t byte = 0; byte < 16; byte++)
                     {
-                        uint8_t sprite_data1 = chip8->ram[chip8->I + 2 * byte];
-                        uint8_t sprite_data2 = chip8->ram[chip8->I + 2 * byte + 1];
-
-                        for (uint8_t bit = 0; bit < 8; bit++)
+                        HEAT_READ(chip8->I + 2 * byte);
+                        HEAT_READ(chip8->I + 2 * byte + 1);
+                        const uint8_t sprite_data1 = ram_read(chip8, (chip8->I + 2 * byte) & RAM_MASK);
+                        const uint8_t sprite_data2 = ram_read(chip8, (chip8->I + 2 * byte + 1) & RAM_MASK);
+                        uint8_t *row = &chip8->gfx[((y_coord + byte) % height) * width];
+
+                        gfx_touch(chip8, row);
+                        if (draw_sprite_row(row, x_coord, width, sprite_data1, true) |
+                            draw_sprite_row(row, (x_coord + 8) % width, width, sprite_data2, true))
                         {
-                            uint8_t x1 = (x_coord + bit) % SCREEN_WIDTH_S;
-                            uint8_t x2 = (x_coord + bit + 8) % SCREEN_WIDTH_S;
-                            uint8_t y = (y_coord + byte) % SCREEN_HEIGHT_S;
-
-                            int8_t sprite_pixel1 = sprite_data1 & (0x80 >> bit);
-                            int8_t sprite_pixel2 = sprite_data2 & (0x80 >> bit);
-
-                            if (sprite_pixel1)
-                            {
-                                if (chip8->gfx[x1 + y * SCREEN_WIDTH_S])
-                                {
-                                    chip8->V[0xF] = 1;
-                                }
-                                chip8->gfx[x1 + y * SCREEN_WIDTH_S] ^= 1;
-                            }
-
-                            if (sprite_pixel2)
-                            {
-                                if (chip8->gfx[x2 + y * SCREEN_WIDTH_S])
-                                {
-                                    chip8->V[0xF] = 1;
-                                }
-                                chip8->gfx[x2 + y * SCREEN_WIDTH_S] ^= 1;
-                            }
+                            chip8->V[0xF] = 1;
                         }
                     }
                 }
-                else    //DXYN
+                else    //DXYN, hi-res or on the native 64x32 lo-res surface (doubled at output)
                 {
                     for (uint8_t byte = 0; byte < chip8->inst.N; byte++)
                     {
-                        const uint8_t sprite_data = chip8->ram[chip8->I + byte];
-                        uint8_t x_coord = chip8->V[chip8->inst.X];
-                        uint8_t y_coord = chip8->V[chip8->inst.Y] + byte;
-                    
-                        for (uint8_t bit = 0; bit < 8; bit++)
-                        {
-                            uint8_t screen_width = chip8->hr.HiRes ? SCREEN_WIDTH_S : SCREEN_WIDTH;
-                            uint8_t screen_height = chip8->hr.HiRes ? SCREEN_HEIGHT_S : SCREEN_HEIGHT;
-                            uint8_t x = (x_coord + bit) % screen_width;
-                            uint8_t y = y_coord % screen_height;
+                        HEAT_READ(chip8->I + byte);
+                        const uint8_t sprite_data = ram_read(chip8, (chip8->I + byte) & RAM_MASK);
 
-                            int8_t sprite_pixel = sprite_data & (0x80 >> bit);
-                    
-                            if (sprite_pixel)
-                            {
-                                if (chip8->hr.HiRes)
-                                {
-                                    if (chip8->gfx[x + y * SCREEN_WIDTH_S])
-                                    {
-                                        chip8->V[0xF] = 1;
-                                    }
-                                    chip8->gfx[x + y * SCREEN_WIDTH_S] ^= 1;
-                                }
-                                else    //LowRes
-                                {
-                                    uint8_t x_lowres = (x * 2) % SCREEN_WIDTH_S;
-                                    uint8_t y_lowres = (y * 2) % SCREEN_HEIGHT_S;
-
-                                    uint8_t screen_pixel = chip8->gfx[x_lowres + y_lowres * SCREEN_WIDTH_S] |
-                                                           chip8->gfx[(x_lowres + 1) % SCREEN_WIDTH_S + y_lowres * SCREEN_WIDTH_S] |
-                                                           chip8->gfx[x_lowres + ((y_lowres + 1) % SCREEN_HEIGHT_S) * SCREEN_WIDTH_S] |
-                                                           chip8->gfx[(x_lowres + 1) % SCREEN_WIDTH_S + ((y_lowres + 1) % SCREEN_HEIGHT_S) * SCREEN_WIDTH_S];
-
-                                    if (screen_pixel)
-                                    {
-                                        chip8->V[0xF] = 1;
-                                    }
-                                    
-                                    chip8->gfx[x_lowres + y_lowres * SCREEN_WIDTH_S] ^= 1;
-                                    chip8->gfx[(x_lowres + 1) % SCREEN_WIDTH_S + y_lowres * SCREEN_WIDTH_S] ^= 1;
-                                    chip8->gfx[x_lowres + ((y_lowres + 1) % SCREEN_HEIGHT_S) * SCREEN_WIDTH_S] ^= 1;
-                                    chip8->gfx[(x_lowres + 1) % SCREEN_WIDTH_S + ((y_lowres + 1) % SCREEN_HEIGHT_S) * SCREEN_WIDTH_S] ^= 1;
-                                }
-                            }
+                        //VX and VY are read per row: with X or Y = F a collision moves the later rows
+                        const uint8_t x_coord = chip8->V[chip8->inst.X] % width;
+                        uint8_t *row = &chip8->gfx[((chip8->V[chip8->inst.Y] + byte) % height) * width];
+
+                        gfx_touch(chip8, row);
+                        if (draw_sprite_row(row, x_coord, width, sprite_data, true))
+                        {
+                            chip8->V[0xF] = 1;
                         }
                     }
                 }
                 chip8->draw_flag = true;
             }
+#ifndef CHIP8_QUIET
             else
             {
                 fprintf(stderr, "0xDXYN insruction error 2\n");
             }
+#endif
+            PERF_END(REGION_SPRITE, perf);
             break;
 
         case 0xE000:
@@ -535,7 +582,7 @@ void instruction_execution(chip8_t *chip8)
                 case 0xE09E:
                     chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
 
-                    if (chip8->keyboard[chip8->V[chip8->inst.X]])
+                    if (chip8->keyboard[chip8->V[chip8->inst.X] & 0x0F])
                     {
                         chip8->PC += 2;
                     }
@@ -545,7 +592,7 @@ void instruction_execution(chip8_t *chip8)
                 case 0xE0A1:
                     chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
                     
-                    if (!chip8->keyboard[chip8->V[chip8->inst.X]])
+                    if (!chip8->keyboard[chip8->V[chip8->inst.X] & 0x0F])
                     {
                         chip8->PC += 2;
                     }
@@ -608,7 +655,7 @@ void instruction_execution(chip8_t *chip8)
 
                     chip8->I += chip8->V[chip8->inst.X];
 
-                    if (chip8->mod.CHIP == true)
+                    if (chip)
                     {
                         chip8->V[0xF] = chip8->I > 0xFFF;
                     }
@@ -635,9 +682,12 @@ void instruction_execution(chip8_t *chip8)
                 case 0xF033:
                     chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
 
-                    chip8->ram[chip8->I + 0] = (chip8->V[chip8->inst.X] / 100) % 10;
-                    chip8->ram[chip8->I + 1] = (chip8->V[chip8->inst.X] / 10) % 10;
-                    chip8->ram[chip8->I + 2] = (chip8->V[chip8->inst.X] / 1) % 10;
+                    HEAT_WRITE(chip8->I + 0);
+                    HEAT_WRITE(chip8->I + 1);
+                    HEAT_WRITE(chip8->I + 2);
+                    ram_write(chip8, (chip8->I + 0) & RAM_MASK, (chip8->V[chip8->inst.X] / 100) % 10);
+                    ram_write(chip8, (chip8->I + 1) & RAM_MASK, (chip8->V[chip8->inst.X] / 10) % 10);
+                    ram_write(chip8, (chip8->I + 2) & RAM_MASK, (chip8->V[chip8->inst.X] / 1) % 10);
                     break;
 
                 //Opcode FX55: Stores from V0 to VX (including VX) in memory,
@@ -646,20 +696,22 @@ void instruction_execution(chip8_t *chip8)
                 case 0xF055:
                     chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
 
-                    if (chip8->mod.CHIP == true)
+                    if (chip)
                     {
                         for (uint8_t i = 0; i <= chip8->inst.X; ++i)
                         {
-                            chip8->ram[chip8->I++] = chip8->V[i];
+                            HEAT_WRITE(chip8->I);
+                            ram_write(chip8, chip8->I++ & RAM_MASK, chip8->V[i]);
                         }
 
                         chip8->I += chip8->inst.X + 1;
                     }
-                    else if (chip8->mod.SUPERCHIP == true)
+                    else if (schip)
                     {
                         for (uint8_t i = 0; i <= chip8->inst.X; ++i)
                         {
-                            chip8->ram[chip8->I + i] = chip8->V[i];
+                            HEAT_WRITE(chip8->I + i);
+                            ram_write(chip8, (chip8->I + i) & RAM_MASK, chip8->V[i]);
                         }
 
                         chip8->I += chip8->inst.X;
@@ -672,20 +724,22 @@ void instruction_execution(chip8_t *chip8)
                 case 0xF065:
                     chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
 
-                    if (chip8->mod.CHIP == true)
+                    if (chip)
                     {
                         for (uint8_t i = 0; i <= chip8->inst.X; ++i)
                         {
-                            chip8->V[i] = chip8->ram[chip8->I++];
+                            HEAT_READ(chip8->I);
+                            chip8->V[i] = ram_read(chip8, chip8->I++ & RAM_MASK);
                         }
 
                         chip8->I += chip8->inst.X + 1;
                     }
-                    else if (chip8->mod.SUPERCHIP == true)
+                    else if (schip)
                     {
                         for (uint8_t i = 0; i <= chip8->inst.X; ++i)
                         {
-                            chip8->V[i] = chip8->ram[chip8->I + i];
+                            HEAT_READ(chip8->I + i);
+                            chip8->V[i] = ram_read(chip8, (chip8->I + i) & RAM_MASK);
                         }
 
                         chip8->I += chip8->inst.X;
@@ -695,14 +749,22 @@ void instruction_execution(chip8_t *chip8)
                 //Opcode FX75: Stores V0 to VX (including VX) in RPL user flags (X <= 7)
                 case 0xF075:
                     chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
-                    assert(chip8->inst.X <= 7);
+                    if (chip8->inst.X >= NUM_RPL)
+                    {
+                        handle_undef_inst(chip8);
+                        break;
+                    }
                     memcpy(chip8->RPL, chip8->V, chip8->inst.X + 1);
                     break;
 
                 //Opcode FX85: Fills V0 to VX (including VX) with values from RPL user flags (X <= 7)
                 case 0xF085:
-                    chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;   
-                    assert(chip8->inst.X <= 7);
+                    chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
+                    if (chip8->inst.X >= NUM_RPL)
+                    {
+                        handle_undef_inst(chip8);
+                        break;
+                    }
                     memcpy(chip8->V, chip8->RPL, chip8->inst.X + 1);
                     break;
                     
@@ -718,9 +780,80 @@ void instruction_execution(chip8_t *chip8)
     }
 }
 
+//Runs count instructions, staying in one specialized core until 00FE/00FF switches it
+static void run_batch(chip8_t *chip8, uint32_t count)
+{
+    PERF_SAMPLE(perf);
+    PERF_BEGIN(perf);
+
+    while (count > 0)
+    {
+        const chip8_engine_t engine = chip8->engine;
+
+        switch (engine)
+        {
+            case ENGINE_CHIP8:
+                do
+                {
+                    execute(chip8, ENGINE_CHIP8);
+                } while (--count > 0 && chip8->engine == engine);
+                break;
+
+            case ENGINE_SCHIP_LORES:
+                do
+                {
+                    execute(chip8, ENGINE_SCHIP_LORES);
+                } while (--count > 0 && chip8->engine == engine);
+                break;
+
+            case ENGINE_SCHIP_HIRES:
+                do
+                {
+                    execute(chip8, ENGINE_SCHIP_HIRES);
+                } while (--count > 0 && chip8->engine == engine);
+                break;
+
+            case ENGINE_XOCHIP:
+                do
+                {
+                    execute(chip8, ENGINE_XOCHIP);
+                } while (--count > 0 && chip8->engine == engine);
+                break;
+        }
+    }
+
+    PERF_END(REGION_DISPATCH, perf);
+}
+
+//Runs count instructions on the emulated clock: the timers tick once every
+//inst_per_frame instructions, however the host splits the work into calls
+void run_instructions(chip8_t *chip8, uint32_t count)
+{
+    while (count > 0)
+    {
+        const uint32_t chunk = (count < chip8->timer_cycles) ? count : chip8->timer_cycles;
+
+        run_batch(chip8, chunk);
+        count -= chunk;
+        chip8->timer_cycles -= chunk;
+
+        if (chip8->timer_cycles == 0)
+        {
+            tick_timers(chip8);
+            chip8->timer_cycles = inst_per_frame(chip8);
+        }
+    }
+}
+
+//One instruction and nothing else; timers are left to the caller
+void instruction_execution(chip8_t *chip8)
+{
+    run_batch(chip8, 1);
+}
+
 void db_instruction_execution(chip8_t *chip8)
 {
-    chip8->inst.opcode = (chip8->ram[chip8->PC] << 8) | chip8->ram[chip8->PC + 1];
+    chip8->inst.opcode = (ram_read(chip8, chip8->PC & RAM_MASK) << 8) | ram_read(chip8, (chip8->PC + 1) & RAM_MASK);
     printf("Executing instruction: 0x%X at PC: 0x%X\n", chip8->inst.opcode, chip8->PC);
 
     printf("PC: %04X, I: %04X\n", chip8->PC, chip8->I);
@@ -999,7 +1132,7 @@ void db_instruction_execution(chip8_t *chip8)
                     chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
                     for (int i = 0; i <= chip8->inst.X; i++)
                     {
-                        printf("Memory[%04X]: %02X\n", chip8->I + i, chip8->ram[chip8->I + i]);
+                        printf("Memory[%04X]: %02X\n", chip8->I + i, ram_read(chip8, (chip8->I + i) & RAM_MASK));
                     }
                     printf("Opcode F065: Fill V[0] to V[%d] with values from memory starting at address I\n", chip8->inst.X);
                     break;
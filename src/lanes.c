@@ -0,0 +1,92 @@
+#include "lockstep.h"
+
+//Runs the same ROM in every lane, once through lockstep and once as separate
+//chip8_t copies, then checks both agree and reports aggregate throughput
+
+static double seconds(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 2 || argc > 5)
+    {
+        fprintf(stderr, "Usage: %s <path-to-rom_file.ch8> [-s/-xo] [lanes] [frames]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *rom_file = argv[1];
+    const char *mod = (argc >= 3) ? argv[2] : "CHIP8";
+    const uint8_t count = (argc >= 4) ? atoi(argv[3]) : LANES;
+    const uint32_t frames = (argc >= 5) ? strtoul(argv[4], NULL, 10) : 60000;
+
+    if (count == 0 || count > LANES)
+    {
+        fprintf(stderr, "Lanes must be between 1 and %d\n", LANES);
+        exit(EXIT_FAILURE);
+    }
+
+    static chip8_t scalar[LANES];
+    static chip8_t vector[LANES];
+    static chip8_lanes_t lanes;
+
+    for (uint8_t l = 0; l < count; l++)
+    {
+        if (!system_init(&scalar[l], mod) || !load_rom(&scalar[l], rom_file))
+        {
+            exit(EXIT_FAILURE);
+        }
+        seed_rng(&scalar[l], 1 + l);
+        vector[l] = scalar[l];
+    }
+
+    const uint16_t frame_budget = inst_per_frame(&scalar[0]);
+
+    double start = seconds();
+    for (uint32_t f = 0; f < frames; f++)
+    {
+        for (uint8_t l = 0; l < count; l++)
+        {
+            run_frame(&scalar[l]);
+        }
+    }
+    const double scalar_time = seconds() - start;
+
+    lanes_init(&lanes, vector, count);
+
+    start = seconds();
+    for (uint32_t f = 0; f < frames; f++)
+    {
+        lanes_run(&lanes, frame_budget);
+
+        for (uint8_t l = 0; l < count; l++)
+        {
+            tick_timers(lanes.lane[l]);
+        }
+    }
+    lanes_sync(&lanes);
+    const double vector_time = seconds() - start;
+
+    uint8_t mismatches = 0;
+    for (uint8_t l = 0; l < count; l++)
+    {
+        if (scalar[l].PC != vector[l].PC || scalar[l].I != vector[l].I ||
+            memcmp(scalar[l].V, vector[l].V, sizeof(scalar[l].V)) != 0 ||
+            memcmp(scalar[l].ram, vector[l].ram, sizeof(scalar[l].ram)) != 0 ||
+            memcmp(scalar[l].gfx, vector[l].gfx, sizeof(scalar[l].gfx)) != 0)
+        {
+            fprintf(stderr, "Lane %d diverged from its scalar copy\n", l);
+            mismatches++;
+        }
+    }
+
+    const double total = (double)frames * frame_budget * count;
+    printf("Lanes: %d, frames: %u\n", count, frames);
+    printf("Separate copies: %.1f M inst/s\n", total / scalar_time / 1e6);
+    printf("Lockstep:        %.1f M inst/s\n", total / vector_time / 1e6);
+    printf("Vector steps: %llu, scalar fallbacks: %llu\n",
+           (unsigned long long)lanes.vector_steps, (unsigned long long)lanes.scalar_steps);
+
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#include "chip8.h"
+#include "libchip8.h"
+
+chip8_t *chip8_create(const char *mod, uint32_t seed)
+{
+    chip8_t *chip8 = calloc(1, sizeof(chip8_t));
+    if (chip8 == NULL)
+    {
+        return NULL;
+    }
+
+    if (!system_init(chip8, mod))
+    {
+        system_release(chip8);
+        free(chip8);
+        return NULL;
+    }
+    seed_rng(chip8, seed);
+
+    return chip8;
+}
+
+void chip8_destroy(chip8_t *chip8)
+{
+    system_release(chip8);
+    free(chip8);
+}
+
+//Bytes this instance owns: the machine itself plus the RAM pages it has
+//written. The shared font + ROM image is not counted
+size_t chip8_memory_use(const chip8_t *chip8)
+{
+    size_t size = sizeof(chip8_t);
+
+#ifdef CHIP8_PAGED_RAM
+    for (uint8_t p = 0; p < RAM_PAGES; p++)
+    {
+        size += ((chip8->owned >> p) & 1) * RAM_PAGE_SIZE;
+    }
+#endif
+
+    return size;
+}
+
+bool chip8_load(chip8_t *chip8, const uint8_t *rom, size_t size)
+{
+    //Keep the variant and RNG stream, reset everything else
+    const chip8_mods_t mod = chip8->mod;
+    const uint32_t rng = chip8->rng;
+
+    if (size > RAM_SIZE - START_ADDRESS)
+    {
+        fprintf(stderr, "Error rom too big, available size up to 3584 bytes\n");
+        return false;
+    }
+
+    if (!system_init(chip8, mod.SUPERCHIP ? "-s" : mod.XOCHIP ? "-xo" : "CHIP8"))
+    {
+        return false;
+    }
+    chip8->rng = rng;
+
+    return load_rom_buffer(chip8, rom, size);
+}
+
+void chip8_step_frame(chip8_t *chip8)
+{
+    if (chip8->state == RUNNING)
+    {
+        run_frame(chip8);
+    }
+}
+
+void chip8_step(chip8_t *chip8, uint32_t count)
+{
+    if (chip8->state == RUNNING)
+    {
+        run_instructions(chip8, count);
+    }
+}
+
+bool chip8_halted(const chip8_t *chip8)
+{
+    return chip8->state == QUIT;
+}
+
+void chip8_set_keys(chip8_t *chip8, uint16_t keys)
+{
+    for (uint8_t i = 0; i < NUM_KEYS; i++)
+    {
+        chip8->keyboard[i] = (keys >> i) & 1;
+    }
+}
+
+const uint8_t *chip8_framebuffer(const chip8_t *chip8, uint8_t *width, uint8_t *height)
+{
+    const bool lores = gfx_lores(chip8);
+
+    if (width != NULL)
+    {
+        *width = lores ? SCREEN_WIDTH : SCREEN_WIDTH_S;
+    }
+    if (height != NULL)
+    {
+        *height = lores ? SCREEN_HEIGHT : SCREEN_HEIGHT_S;
+    }
+
+    return chip8->gfx;
+}
+
+//True once per batch of drawing, so frontends only upload changed screens
+bool chip8_screen_changed(chip8_t *chip8)
+{
+    const bool changed = chip8->draw_flag;
+
+    chip8->draw_flag = false;
+    return changed;
+}
+
+bool chip8_beeping(const chip8_t *chip8)
+{
+    return chip8->sound_timer > 0;
+}
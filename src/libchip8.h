@@ -0,0 +1,81 @@
+#ifndef LIBCHIP8_H
+#define LIBCHIP8_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+//Embedding API for the interpreter core, with no SDL dependency. Every
+//instance carries its own state (RNG included), so any number of them can
+//run side by side, each driven from one thread at a time.
+
+#ifndef CHIP8_H
+typedef struct chip8_t chip8_t;         //Opaque outside the core
+#endif
+
+//mod is "CHIP8", "-s" or "-xo"; NULL on a bad mode or out of memory
+chip8_t *chip8_create(const char *mod, uint32_t seed);
+void chip8_destroy(chip8_t *chip8);
+
+//Instances of the same ROM share its pages until they write to them
+size_t chip8_memory_use(const chip8_t *chip8);
+
+//Restarts the machine with the given ROM image
+bool chip8_load(chip8_t *chip8, const uint8_t *rom, size_t size);
+
+//One 60 Hz frame (instructions plus a timer tick), or exactly count instructions
+void chip8_step_frame(chip8_t *chip8);
+void chip8_step(chip8_t *chip8, uint32_t count);
+bool chip8_halted(const chip8_t *chip8);
+
+//Bit n set means key n is held
+void chip8_set_keys(chip8_t *chip8, uint16_t keys);
+
+//One byte per pixel, non-zero when lit, row-major at the current surface size:
+//64x32 for CHIP-8 and SCHIP lo-res, 128x64 otherwise
+const uint8_t *chip8_framebuffer(const chip8_t *chip8, uint8_t *width, uint8_t *height);
+bool chip8_screen_changed(chip8_t *chip8);
+
+//The buzzer sounds while the sound timer is running
+bool chip8_beeping(const chip8_t *chip8);
+
+//Batched environments for training loops: count instances of one ROM stepped
+//together, each writing its observation, reward and done flag into a single
+//buffer the caller owns. Steps allocate nothing. On POSIX the batch is split
+//across a pool of threads created with it; on Windows it runs on the caller
+typedef struct chip8_batch_t chip8_batch_t;
+
+//Where each part of the step buffer lives, offsets in bytes
+typedef struct {
+    uint16_t width;                     //Observation size after downsampling
+    uint16_t height;
+    size_t obs;                         //count * width * height bytes, one screen per environment
+    size_t reward;                      //count floats
+    size_t done;                        //count bytes, non-zero once the machine halted
+    size_t size;                        //Whole buffer
+} chip8_batch_layout_t;
+
+//Environment i is seeded with seed + i; threads 0 means one per CPU
+chip8_batch_t *chip8_batch_create(const char *mod, const uint8_t *rom, size_t size,
+                                  uint32_t count, uint32_t seed, uint32_t threads);
+void chip8_batch_destroy(chip8_batch_t *batch);
+
+//Observations are the variant's output screen (64x32 or 128x64) shrunk by
+//factor 1, 2, 4 or 8, each cell the share of lit pixels under it (0-255)
+bool chip8_batch_downsample(chip8_batch_t *batch, uint8_t factor);
+
+//Adds weight times the change of the big-endian value of bytes (1-4) at addr
+//to every step's reward; up to 8 terms
+bool chip8_batch_reward(chip8_batch_t *batch, uint16_t addr, uint8_t bytes, float weight);
+
+void chip8_batch_layout(const chip8_batch_t *batch, chip8_batch_layout_t *layout);
+chip8_t *chip8_batch_env(chip8_batch_t *batch, uint32_t index);
+
+//Reloads every environment and writes the first observations, rewards 0
+void chip8_batch_reset(chip8_batch_t *batch, void *buffer);
+
+//Environment i holds keys actions[i] for frames frames. One that halted on
+//its previous step is reloaded first, so episodes restart on their own
+void chip8_batch_step(chip8_batch_t *batch, const uint16_t *actions, uint32_t frames, void *buffer);
+
+#endif
@@ -0,0 +1,673 @@
+#include "lockstep.h"
+#include "sprite.h"
+
+typedef int8_t lane_s8_t __attribute__((vector_size(LANES)));
+typedef int16_t lane_s16_t __attribute__((vector_size(LANES * 2)));
+
+//Select a where mask is set and b elsewhere
+static inline lane_u8_t blend8(lane_u8_t mask, lane_u8_t a, lane_u8_t b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+static inline lane_u16_t blend16(lane_u16_t mask, lane_u16_t a, lane_u16_t b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+//Sign-extend a byte mask (0x00/0xFF) into a word mask (0x0000/0xFFFF)
+static inline lane_u16_t widen_mask(lane_u8_t mask)
+{
+    return (lane_u16_t)__builtin_convertvector((lane_s8_t)mask, lane_s16_t);
+}
+
+static inline lane_u16_t widen(lane_u8_t v)
+{
+    return __builtin_convertvector(v, lane_u16_t);
+}
+
+//Same xorshift step as instruction_execution, so lanes stay bit-exact with scalar runs
+static inline uint8_t next_random(chip8_t *chip8)
+{
+    uint32_t x = chip8->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip8->rng = x;
+
+    return x >> 24;
+}
+
+static void gather_lane(chip8_lanes_t *lanes, uint8_t l)
+{
+    const chip8_t *chip8 = lanes->lane[l];
+
+    for (uint8_t r = 0; r < NUM_REGS; r++)
+    {
+        lanes->V[r][l] = chip8->V[r];
+    }
+    lanes->I[l] = chip8->I;
+    lanes->PC[l] = chip8->PC;
+}
+
+static void scatter_lane(chip8_lanes_t *lanes, uint8_t l)
+{
+    chip8_t *chip8 = lanes->lane[l];
+
+    for (uint8_t r = 0; r < NUM_REGS; r++)
+    {
+        chip8->V[r] = lanes->V[r][l];
+    }
+    chip8->I = lanes->I[l];
+    chip8->PC = lanes->PC[l];
+}
+
+static void note_store(chip8_lanes_t *lanes, uint16_t first, uint16_t last)
+{
+    //Stores past the top of RAM wrap around to the bottom
+    if (last > RAM_MASK)
+    {
+        first = 0;
+        last = RAM_MASK;
+    }
+
+    if (first < lanes->store_lo)
+    {
+        lanes->store_lo = first;
+    }
+
+    if (last > lanes->store_hi)
+    {
+        lanes->store_hi = last;
+    }
+}
+
+static void scalar_step(chip8_lanes_t *lanes, uint8_t l)
+{
+    const chip8_t *chip8 = lanes->lane[l];
+    const uint16_t opcode = (chip8->ram[lanes->PC[l] & RAM_MASK] << 8) | chip8->ram[(lanes->PC[l] + 1) & RAM_MASK];
+
+    if ((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055)
+    {
+        note_store(lanes, lanes->I[l], lanes->I[l] + 2 * (((opcode >> 8) & 0x0F) + 1));
+    }
+
+    scatter_lane(lanes, l);
+    instruction_execution(lanes->lane[l]);
+    gather_lane(lanes, l);
+    lanes->scalar_steps++;
+}
+
+void lanes_init(chip8_lanes_t *lanes, chip8_t *instances, uint8_t count)
+{
+    assert(count > 0 && count <= LANES);
+
+    memset(lanes, 0, sizeof(chip8_lanes_t));
+    lanes->num_lanes = count;
+    lanes->store_lo = UINT16_MAX;
+
+    for (uint8_t l = 0; l < count; l++)
+    {
+        //Quirks are resolved once for the whole group, so every lane must run the same variant
+        assert(memcmp(&instances[l].mod, &instances[0].mod, sizeof(chip8_mods_t)) == 0);
+
+        lanes->lane[l] = &instances[l];
+        lanes->active[l] = 0xFF;
+        gather_lane(lanes, l);
+    }
+}
+
+void lanes_sync(chip8_lanes_t *lanes)
+{
+    for (uint8_t l = 0; l < lanes->num_lanes; l++)
+    {
+        scatter_lane(lanes, l);
+    }
+}
+
+//Stack faults are reported by instruction_execution, so a group that would
+//fault anywhere is handed to the scalar path instead
+static bool stacks_ok(const chip8_lanes_t *lanes, lane_u8_t mask, bool push)
+{
+    for (uint8_t l = 0; l < lanes->num_lanes; l++)
+    {
+        const uint8_t SP = lanes->lane[l]->SP;
+
+        if (mask[l] && (push ? SP >= STACK_SIZE - 1 : SP == 0))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//DXYN on one lane, drawn as instruction_execution would for the lane's engine.
+//VX and VY are read from the lane registers, and VF is written back there
+static void draw_lane(chip8_lanes_t *lanes, uint8_t l, uint8_t X, uint8_t Y, uint8_t N)
+{
+    chip8_t *chip8 = lanes->lane[l];
+    lane_u8_t *V = lanes->V;
+    const uint16_t I = lanes->I[l];
+
+    V[0xF][l] = 0;
+
+    if (chip8->engine == ENGINE_CHIP8)
+    {
+        const uint8_t x_coord = V[X][l] % SCREEN_WIDTH;
+        uint8_t y_coord = V[Y][l] % SCREEN_HEIGHT;
+
+        for (uint8_t y = 0; y < N && y_coord < SCREEN_HEIGHT; y++, y_coord++)
+        {
+            uint8_t *row = &chip8->gfx[y_coord * SCREEN_WIDTH];
+
+            gfx_touch(chip8, row);
+            if (draw_sprite_row(row, x_coord, SCREEN_WIDTH, ram_read(chip8, (I + y) & RAM_MASK), false))
+            {
+                V[0xF][l] = 1;
+            }
+        }
+    }
+    else
+    {
+        const bool hires = (chip8->engine == ENGINE_SCHIP_HIRES);
+        const uint8_t width = hires ? SCREEN_WIDTH_S : SCREEN_WIDTH;
+        const uint8_t height = hires ? SCREEN_HEIGHT_S : SCREEN_HEIGHT;
+
+        if (hires && N == 0)
+        {
+            const uint8_t x_coord = V[X][l] % width;
+            const uint8_t y_coord = V[Y][l];
+
+            for (uint8_t byte = 0; byte < 16; byte++)
+            {
+                uint8_t *row = &chip8->gfx[((y_coord + byte) % height) * width];
+
+                gfx_touch(chip8, row);
+                if (draw_sprite_row(row, x_coord, width, ram_read(chip8, (I + 2 * byte) & RAM_MASK), true) |
+                    draw_sprite_row(row, (x_coord + 8) % width, width, ram_read(chip8, (I + 2 * byte + 1) & RAM_MASK), true))
+                {
+                    V[0xF][l] = 1;
+                }
+            }
+        }
+        else
+        {
+            //Per row, like the scalar core: with X or Y = F a collision moves the later rows
+            for (uint8_t byte = 0; byte < N; byte++)
+            {
+                uint8_t *row = &chip8->gfx[((V[Y][l] + byte) % height) * width];
+
+                gfx_touch(chip8, row);
+                if (draw_sprite_row(row, V[X][l] % width, width, ram_read(chip8, (I + byte) & RAM_MASK), true))
+                {
+                    V[0xF][l] = 1;
+                }
+            }
+        }
+    }
+
+    chip8->draw_flag = true;
+}
+
+//Executes one opcode on every lane selected by mask. Returns false if the opcode
+//has no vector form, in which case nothing was modified.
+static bool vector_step(chip8_lanes_t *lanes, uint16_t opcode, lane_u8_t mask)
+{
+    const chip8_mods_t mod = lanes->lane[0]->mod;
+    const uint16_t NNN = opcode & 0x0FFF;
+    const uint8_t NN = opcode & 0x00FF;
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t Y = (opcode >> 4) & 0x0F;
+    const lane_u16_t mask16 = widen_mask(mask);
+    lane_u8_t *V = lanes->V;
+    lane_u8_t result;
+    lane_u8_t carry;
+
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+            //Opcode 00EE: Return from subroutine, each lane pops its own stack
+            if (opcode == 0x00EE)
+            {
+                if (!stacks_ok(lanes, mask, false))
+                {
+                    return false;
+                }
+
+                for (uint8_t l = 0; l < lanes->num_lanes; l++)
+                {
+                    if (mask[l])
+                    {
+                        chip8_t *chip8 = lanes->lane[l];
+                        lanes->PC[l] = chip8->stack[chip8->SP--];
+                    }
+                }
+                return true;
+            }
+
+            //Opcode 00E0: Clear screen, lane by lane
+            if (opcode == 0x00E0)
+            {
+                for (uint8_t l = 0; l < lanes->num_lanes; l++)
+                {
+                    if (mask[l])
+                    {
+                        chip8_t *chip8 = lanes->lane[l];
+
+                        memset(chip8->gfx, 0, sizeof(chip8->gfx));
+                        chip8->gfx_dirty = UINT32_MAX;
+                        chip8->draw_flag = true;
+                    }
+                }
+                break;
+            }
+            return false;
+
+        //Opcode 2NNN: Calls subroutine at NNN
+        case 0x2000:
+            if (!stacks_ok(lanes, mask, true))
+            {
+                return false;
+            }
+
+            for (uint8_t l = 0; l < lanes->num_lanes; l++)
+            {
+                if (mask[l])
+                {
+                    chip8_t *chip8 = lanes->lane[l];
+                    chip8->stack[++chip8->SP] = lanes->PC[l] + 2;
+                }
+            }
+            lanes->PC = blend16(mask16, (lane_u16_t){0} + NNN, lanes->PC);
+            return true;
+
+        //Opcode 1NNN: Jump to address NNN
+        case 0x1000:
+            lanes->PC = blend16(mask16, (lane_u16_t){0} + NNN, lanes->PC);
+            return true;
+
+        //Opcodes 3XNN/4XNN/5XY0/9XY0: Conditional skips, each lane advances on its own
+        case 0x3000:
+            lanes->PC += (2 + 2 * widen((lane_u8_t)(V[X] == NN) & 1)) & mask16;
+            return true;
+
+        case 0x4000:
+            lanes->PC += (2 + 2 * widen((lane_u8_t)(V[X] != NN) & 1)) & mask16;
+            return true;
+
+        case 0x5000:
+            lanes->PC += (2 + 2 * widen((lane_u8_t)(V[X] == V[Y]) & 1)) & mask16;
+            return true;
+
+        case 0x9000:
+            lanes->PC += (2 + 2 * widen((lane_u8_t)(V[X] != V[Y]) & 1)) & mask16;
+            return true;
+
+        //Opcode 6XNN: Set VX to NN
+        case 0x6000:
+            V[X] = blend8(mask, (lane_u8_t){0} + NN, V[X]);
+            break;
+
+        //Opcode 7XNN: Adds NN to VX (carry flag not changed)
+        case 0x7000:
+            V[X] = blend8(mask, V[X] + NN, V[X]);
+            break;
+
+        case 0x8000:
+            switch (opcode & 0x000F)
+            {
+                case 0x0000:
+                    V[X] = blend8(mask, V[Y], V[X]);
+                    break;
+
+                case 0x0001:
+                case 0x0002:
+                case 0x0003:
+                    if ((opcode & 0x000F) == 1)
+                    {
+                        result = V[X] | V[Y];
+                    }
+                    else if ((opcode & 0x000F) == 2)
+                    {
+                        result = V[X] & V[Y];
+                    }
+                    else
+                    {
+                        result = V[X] ^ V[Y];
+                    }
+
+                    V[X] = blend8(mask, result, V[X]);
+
+                    if (mod.CHIP == true)
+                    {
+                        V[0xF] = blend8(mask, (lane_u8_t){0}, V[0xF]);
+                    }
+                    break;
+
+                case 0x0004:
+                    result = V[X] + V[Y];
+                    carry = (lane_u8_t)(result < V[X]) & 1;
+                    V[X] = blend8(mask, result, V[X]);
+                    V[0xF] = blend8(mask, carry, V[0xF]);
+                    break;
+
+                case 0x0005:
+                    carry = (lane_u8_t)(V[Y] <= V[X]) & 1;
+                    V[X] = blend8(mask, V[X] - V[Y], V[X]);
+                    V[0xF] = blend8(mask, carry, V[0xF]);
+                    break;
+
+                case 0x0006:
+                    carry = (lane_u8_t){0};
+
+                    if (mod.CHIP == true)
+                    {
+                        carry = V[Y] & 1;
+                        V[X] = blend8(mask, V[Y] >> 1, V[X]);
+                    }
+                    else if (mod.SUPERCHIP == true)
+                    {
+                        carry = V[X] & 1;
+                        V[X] = blend8(mask, V[X] >> 1, V[X]);
+                    }
+
+                    V[0xF] = blend8(mask, carry, V[0xF]);
+                    break;
+
+                case 0x0007:
+                    carry = (lane_u8_t)(V[X] <= V[Y]) & 1;
+                    V[X] = blend8(mask, V[Y] - V[X], V[X]);
+                    V[0xF] = blend8(mask, carry, V[0xF]);
+                    break;
+
+                case 0x000E:
+                    carry = (lane_u8_t){0};
+
+                    if (mod.CHIP == true)
+                    {
+                        carry = V[Y] >> 7;
+                        V[X] = blend8(mask, V[Y] << 1, V[X]);
+                    }
+                    else if (mod.SUPERCHIP == true)
+                    {
+                        carry = V[X] >> 7;
+                        V[X] = blend8(mask, V[X] << 1, V[X]);
+                    }
+
+                    V[0xF] = blend8(mask, carry, V[0xF]);
+                    break;
+
+                default:
+                    return false;
+            }
+            break;
+
+        //Opcode ANNN: Sets I to the address NNN
+        case 0xA000:
+            lanes->I = blend16(mask16, (lane_u16_t){0} + NNN, lanes->I);
+            break;
+
+        //Opcode CXNN: Random number, drawn from each lane's own generator
+        case 0xC000:
+            for (uint8_t l = 0; l < lanes->num_lanes; l++)
+            {
+                if (mask[l])
+                {
+                    V[X][l] = next_random(lanes->lane[l]) & NN;
+                }
+            }
+            break;
+
+        //Opcode BNNN: Jumps to the address NNN + V0 (VX on SUPERCHIP)
+        case 0xB000:
+            if (mod.CHIP == true)
+            {
+                lanes->PC = blend16(mask16, widen(V[0]) + NNN, lanes->PC);
+                return true;
+            }
+            else if (mod.SUPERCHIP == true)
+            {
+                lanes->PC = blend16(mask16, widen(V[X]) + NNN, lanes->PC);
+                return true;
+            }
+            break;
+
+        //Opcode DXYN: Each lane draws into its own screen. XO-CHIP is left to
+        //instruction_execution, which reports it
+        case 0xD000:
+            if (mod.XOCHIP == true)
+            {
+                return false;
+            }
+
+            for (uint8_t l = 0; l < lanes->num_lanes; l++)
+            {
+                if (mask[l])
+                {
+                    draw_lane(lanes, l, X, Y, opcode & 0x000F);
+                }
+            }
+            break;
+
+        //Opcodes EX9E/EXA1: Skip on each lane's own key state
+        case 0xE000:
+        {
+            if (NN != 0x9E && NN != 0xA1)
+            {
+                return false;
+            }
+
+            lane_u8_t pressed = {0};
+            for (uint8_t l = 0; l < lanes->num_lanes; l++)
+            {
+                if (mask[l])
+                {
+                    pressed[l] = lanes->lane[l]->keyboard[V[X][l] & 0x0F];
+                }
+            }
+
+            const lane_u8_t skip = (NN == 0x9E) ? pressed : pressed ^ 1;
+            lanes->PC += (2 + 2 * widen(skip)) & mask16;
+            return true;
+        }
+
+        case 0xF000:
+            switch (opcode & 0xF0FF)
+            {
+                //Opcodes FX07/FX15/FX18: Timers stay in each lane's backing state
+                case 0xF007:
+                    for (uint8_t l = 0; l < lanes->num_lanes; l++)
+                    {
+                        if (mask[l])
+                        {
+                            V[X][l] = lanes->lane[l]->delay_timer;
+                        }
+                    }
+                    break;
+
+                case 0xF015:
+                    for (uint8_t l = 0; l < lanes->num_lanes; l++)
+                    {
+                        if (mask[l])
+                        {
+                            lanes->lane[l]->delay_timer = V[X][l];
+                        }
+                    }
+                    break;
+
+                case 0xF018:
+                    for (uint8_t l = 0; l < lanes->num_lanes; l++)
+                    {
+                        if (mask[l])
+                        {
+                            lanes->lane[l]->sound_timer = V[X][l];
+                        }
+                    }
+                    break;
+
+                //Opcode FX1E: Adds VX to I
+                case 0xF01E:
+                    lanes->I = blend16(mask16, lanes->I + widen(V[X]), lanes->I);
+
+                    if (mod.CHIP == true)
+                    {
+                        carry = __builtin_convertvector((lane_s16_t)(lanes->I > 0xFFF), lane_u8_t) & 1;
+                        V[0xF] = blend8(mask, carry, V[0xF]);
+                    }
+                    break;
+
+                //Opcode FX29/FX30: Point I at the small or extended font glyph for VX
+                case 0xF029:
+                    lanes->I = blend16(mask16, widen(V[X]) * 5 + FONT_START, lanes->I);
+                    break;
+
+                case 0xF030:
+                    lanes->I = blend16(mask16, widen(V[X]) * 10 + EXTENDED_FONT_START, lanes->I);
+                    break;
+
+                //Opcodes FX33/FX55/FX65: RAM is private to each lane, so these walk the
+                //selected lanes but still skip the scalar decode and register shuffling
+                case 0xF033:
+                    for (uint8_t l = 0; l < lanes->num_lanes; l++)
+                    {
+                        if (mask[l])
+                        {
+                            note_store(lanes, lanes->I[l], lanes->I[l] + 2);
+                        }
+                    }
+
+                    for (uint8_t l = 0; l < lanes->num_lanes; l++)
+                    {
+                        if (mask[l])
+                        {
+                            ram_write(lanes->lane[l], (lanes->I[l] + 0) & RAM_MASK, (V[X][l] / 100) % 10);
+                            ram_write(lanes->lane[l], (lanes->I[l] + 1) & RAM_MASK, (V[X][l] / 10) % 10);
+                            ram_write(lanes->lane[l], (lanes->I[l] + 2) & RAM_MASK, V[X][l] % 10);
+                        }
+                    }
+                    break;
+
+                case 0xF055:
+                case 0xF065:
+                    if (mod.CHIP == false && mod.SUPERCHIP == false)
+                    {
+                        break;
+                    }
+
+                    for (uint8_t l = 0; l < lanes->num_lanes; l++)
+                    {
+                        if (mask[l])
+                        {
+                            uint16_t addr = lanes->I[l];
+
+                            if ((opcode & 0x00FF) == 0x55)
+                            {
+                                note_store(lanes, addr, addr + X);
+                            }
+
+                            for (uint8_t i = 0; i <= X; i++, addr++)
+                            {
+                                if ((opcode & 0x00FF) == 0x55)
+                                {
+                                    ram_write(lanes->lane[l], addr & RAM_MASK, V[i][l]);
+                                }
+                                else
+                                {
+                                    V[i][l] = ram_read(lanes->lane[l], addr & RAM_MASK);
+                                }
+                            }
+                        }
+                    }
+
+                    //Same I quirks as instruction_execution
+                    const uint16_t advance = (mod.CHIP == true) ? 2 * (X + 1) : X;
+                    lanes->I += advance & mask16;
+                    break;
+
+                default:
+                    return false;
+            }
+            break;
+
+        default:
+            return false;
+    }
+
+    lanes->PC += 2 & mask16;
+    return true;
+}
+
+void lanes_run(chip8_lanes_t *lanes, uint16_t budget)
+{
+    lane_u16_t remaining = ((lane_u16_t){0} + budget) & widen_mask(lanes->active);
+
+    for (;;)
+    {
+        //Parked lanes read as 0xFFFF, so the lowest PC goes first and lanes that
+        //fell behind after a skip catch up and re-merge with the rest. Written
+        //as a plain reduction over every lane so it compiles to a vector min
+        const lane_u16_t pcs = lanes->PC | ~(lane_u16_t)(remaining != 0);
+        uint16_t pc = UINT16_MAX;
+
+        for (uint8_t l = 0; l < LANES; l++)
+        {
+            pc = (pcs[l] < pc) ? pcs[l] : pc;
+        }
+
+        if (pc == UINT16_MAX)
+        {
+            break;
+        }
+
+        const lane_u16_t selected16 = (lane_u16_t)(pcs == pc);
+        lane_u8_t mask = __builtin_convertvector((lane_s16_t)selected16, lane_u8_t);
+        uint8_t leader = 0;
+
+        //Outside the stored range every lane still holds the RAM it was loaded
+        //with, so lane 0's copy is as good as any. Code that some lane may have
+        //overwritten has to be fetched lane by lane
+        const bool stored = (pc + 1 >= lanes->store_lo && pc <= lanes->store_hi);
+        if (stored)
+        {
+            while (!mask[leader])
+            {
+                leader++;
+            }
+        }
+
+        const uint8_t hi = lanes->lane[leader]->ram[pc & RAM_MASK];
+        const uint8_t lo = lanes->lane[leader]->ram[(pc + 1) & RAM_MASK];
+        const uint16_t opcode = (hi << 8) | lo;
+
+        if (stored)
+        {
+            for (uint8_t l = 0; l < lanes->num_lanes; l++)
+            {
+                const uint8_t *ram = lanes->lane[l]->ram;
+
+                if (mask[l] && (ram[pc & RAM_MASK] != hi || ram[(pc + 1) & RAM_MASK] != lo))
+                {
+                    mask[l] = 0;
+                }
+            }
+        }
+
+        if (vector_step(lanes, opcode, mask))
+        {
+            lanes->vector_steps++;
+        }
+        else
+        {
+            for (uint8_t l = 0; l < lanes->num_lanes; l++)
+            {
+                if (mask[l])
+                {
+                    scalar_step(lanes, l);
+                }
+            }
+        }
+
+        remaining -= 1 & widen_mask(mask);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "chip8.h"
+
+#define LANES 32
+
+//One vector register holds the same CHIP-8 register for every lane
+typedef uint8_t lane_u8_t __attribute__((vector_size(LANES)));
+typedef uint16_t lane_u16_t __attribute__((vector_size(LANES * 2)));
+
+typedef struct {
+    lane_u8_t V[NUM_REGS];          //V[reg][lane]
+    lane_u16_t I;
+    lane_u16_t PC;
+    chip8_t *lane[LANES];           //Backing state: ram, gfx, stack, timers, keyboard
+    uint8_t num_lanes;
+    lane_u8_t active;               //0xFF for lanes in use, 0 for padding lanes
+    uint16_t store_lo;              //RAM range written by any lane since lanes_init;
+    uint16_t store_hi;              //opcodes fetched from it are compared lane by lane
+    uint64_t vector_steps;          //Instructions executed across lanes at once
+    uint64_t scalar_steps;          //Per-lane instructions that fell back to instruction_execution
+} chip8_lanes_t;
+
+void lanes_init(chip8_lanes_t *lanes, chip8_t *instances, uint8_t count);
+void lanes_run(chip8_lanes_t *lanes, uint16_t budget);
+void lanes_sync(chip8_lanes_t *lanes);
+
+#endif
@@ -1,18 +1,394 @@
 #define SDL_MAIN_HANDLED
 #include "window.h"
+#include "shm.h"
+#include "capture.h"
+#include "debugger.h"
+#include "tribuf.h"
+#include "telemetry.h"
+#include "perfcount.h"
+#include "heatmap.h"
+#include "movie.h"
 
-int main(int argc, char const *argv[])
+#define MAX_RUNAHEAD 8
+
+typedef struct {
+    const char *rom_file;
+    const char *mod;
+    const char *shm_name;
+    const char *capture_path;
+    const char *stats_path;
+    const char *record_path;
+    const char *replay_path;
+    const char *heatmap_path;
+    uint8_t capture_scale;
+    bool capture_dedup;
+    bool headless;
+    bool debug;
+    bool frameskip;
+    bool timing;
+    uint16_t width;                 //Window size
+    uint16_t height;
+    scaler_filter_t filter;
+    uint32_t palette[2];            //Background, foreground as 0xRRGGBB
+    bool scanlines;
+    uint8_t phosphor;
+    uint8_t runahead;
+    uint8_t speed;                  //Emulated frames per host frame
+    uint64_t frames;                //Frames to run headless, 0 runs until the ROM halts
+} options_t;
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s <path-to-rom_file.ch8> [-s/-xo] [options]\n", name);
+    fprintf(stderr, "  --shm <name>          Publish state to POSIX shared memory\n");
+    fprintf(stderr, "  --capture <path>      Record frames to <path>.y4m, or <path>NNNNNN.png files\n");
+    fprintf(stderr, "  --scale <n>           Integer upscale for captured frames\n");
+    fprintf(stderr, "  --dedup               Collapse runs of identical captured frames\n");
+    fprintf(stderr, "  --headless            Run without a window, as fast as possible\n");
+    fprintf(stderr, "  --frames <n>          Stop a headless run after n frames\n");
+    fprintf(stderr, "  --frameskip           Drop presents, never emulated time, when the host falls behind\n");
+    fprintf(stderr, "  --speed <n>           Fast-forward, running n emulated frames per displayed one\n");
+    fprintf(stderr, "  --runahead <n>        Show the screen n frames ahead of the real machine (0-%d)\n", MAX_RUNAHEAD);
+    fprintf(stderr, "  --window <w>x<h>      Window size, the screen is scaled to fit (default %dx%d)\n", WINDOW_WIDTH, WINDOW_HEIGHT);
+    fprintf(stderr, "  --filter <name>       Upscaler: nearest, scale2x or scale3x\n");
+    fprintf(stderr, "  --palette <bg>,<fg>   Screen colours as RRGGBB hex\n");
+    fprintf(stderr, "  --scanlines           Darken the last row of every scaled pixel\n");
+    fprintf(stderr, "  --phosphor <n>        Let dark pixels fade out, keeping n/256 of their glow per screen\n");
+    fprintf(stderr, "  --timing              Print per-stage frame timing percentiles on exit\n");
+    fprintf(stderr, "  --stats <path>        Like --timing, and rewrite <path> with them every second\n");
+    fprintf(stderr, "  --record <path>       Record keypad input, seed and resets to a movie\n");
+    fprintf(stderr, "  --replay <path>       Replay a movie instead of live input, then exit\n");
+#ifdef CHIP8_HEATMAP
+    fprintf(stderr, "  --heatmap <path>      Write per-address read/write/execute counts on exit\n");
+#endif
+    fprintf(stderr, "  --debug               Start at the debugger prompt, Ctrl-C breaks back in\n");
+    exit(EXIT_FAILURE);
+}
+
+static void parse_args(int argc, char const *argv[], options_t *opt)
 {
-    if (argc < 2 || argc > 3)
+    if (argc < 2)
     {
-        fprintf(stderr, "Usage: %s <path-to-rom_file.ch8> [-s/-xo]\n", argv[0]);
-        exit(EXIT_FAILURE);
+        usage(argv[0]);
+    }
+
+    opt->rom_file = argv[1];
+    opt->mod = "CHIP8";
+    opt->capture_scale = 1;
+    opt->speed = 1;
+    opt->width = WINDOW_WIDTH;
+    opt->height = WINDOW_HEIGHT;
+    opt->palette[1] = 0xFFFFFF;
+
+    for (int i = 2; i < argc; i++)
+    {
+        const bool has_value = (i + 1 < argc);
+
+        if (strcmp(argv[i], "--shm") == 0 && has_value)
+        {
+            opt->shm_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--capture") == 0 && has_value)
+        {
+            opt->capture_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--scale") == 0 && has_value)
+        {
+            opt->capture_scale = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dedup") == 0)
+        {
+            opt->capture_dedup = true;
+        }
+        else if (strcmp(argv[i], "--headless") == 0)
+        {
+            opt->headless = true;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && has_value)
+        {
+            opt->frames = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--frameskip") == 0)
+        {
+            opt->frameskip = true;
+        }
+        else if (strcmp(argv[i], "--speed") == 0 && has_value)
+        {
+            const int speed = atoi(argv[++i]);
+            opt->speed = (speed < 1) ? 1 : (speed > 255) ? 255 : speed;
+        }
+        else if (strcmp(argv[i], "--runahead") == 0 && has_value)
+        {
+            const int frames = atoi(argv[++i]);
+            opt->runahead = (frames < 0) ? 0 : (frames > MAX_RUNAHEAD) ? MAX_RUNAHEAD : frames;
+        }
+        else if (strcmp(argv[i], "--window") == 0 && has_value)
+        {
+            unsigned width, height;
+            if (sscanf(argv[++i], "%ux%u", &width, &height) != 2 || width < SCREEN_WIDTH_S ||
+                height < SCREEN_HEIGHT_S || width > 8192 || height > 8192)
+            {
+                usage(argv[0]);
+            }
+            opt->width = width;
+            opt->height = height;
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && has_value)
+        {
+            const char *name = argv[++i];
+            if (strcmp(name, "nearest") == 0)
+            {
+                opt->filter = FILTER_NEAREST;
+            }
+            else if (strcmp(name, "scale2x") == 0)
+            {
+                opt->filter = FILTER_SCALE2X;
+            }
+            else if (strcmp(name, "scale3x") == 0)
+            {
+                opt->filter = FILTER_SCALE3X;
+            }
+            else
+            {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--palette") == 0 && has_value)
+        {
+            unsigned background, foreground;
+            if (sscanf(argv[++i], "%6x,%6x", &background, &foreground) != 2)
+            {
+                usage(argv[0]);
+            }
+            opt->palette[0] = background;
+            opt->palette[1] = foreground;
+        }
+        else if (strcmp(argv[i], "--scanlines") == 0)
+        {
+            opt->scanlines = true;
+        }
+        else if (strcmp(argv[i], "--phosphor") == 0 && has_value)
+        {
+            const int decay = atoi(argv[++i]);
+            opt->phosphor = (decay < 0) ? 0 : (decay > 255) ? 255 : decay;
+        }
+        else if (strcmp(argv[i], "--timing") == 0)
+        {
+            opt->timing = true;
+        }
+        else if (strcmp(argv[i], "--stats") == 0 && has_value)
+        {
+            opt->stats_path = argv[++i];
+            opt->timing = true;
+        }
+        else if (strcmp(argv[i], "--record") == 0 && has_value)
+        {
+            opt->record_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && has_value)
+        {
+            opt->replay_path = argv[++i];
+        }
+#ifdef CHIP8_HEATMAP
+        else if (strcmp(argv[i], "--heatmap") == 0 && has_value)
+        {
+            opt->heatmap_path = argv[++i];
+        }
+#endif
+        else if (strcmp(argv[i], "--debug") == 0)
+        {
+            opt->debug = true;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            usage(argv[0]);
+        }
+        else
+        {
+            opt->mod = argv[i];
+        }
+    }
+}
+
+typedef struct {
+    chip8_t *chip8;
+    sdl_t *sdl;                     //NULL when headless
+    debugger_t *debugger;           //NULL unless --debug
+    chip8_shm_t *shm;
+    capture_t *capture;
+    telemetry_t *telemetry;         //NULL unless --timing
+    movie_t *movie;                 //NULL unless --record or --replay
+    tribuf_t *frames;               //Completed screens for the render thread
+    SDL_mutex *lock;                //Held around a frame and around input handling
+    uint64_t frame;
+    bool frameskip;
+    uint64_t deadline;              //Performance counter value the next frame is due at
+    bool behind;                    //The last frame finished after its deadline
+    uint64_t presented;             //Screens the render thread actually drew
+    uint8_t runahead;               //Speculative frames per real one, 0 to show the real machine
+    uint8_t speed;                  //Frames per 60 Hz period, above 1 to fast-forward
+    chip8_t ahead;                  //Scratch copy the speculative frames run on
+    chip8_t stopped;                //Copy the debugger prompt reads while the lock is released
+} emu_t;
+
+//Present budget for --frameskip: at most this many screens in a row are dropped
+#define MAX_SKIPPED 4
+
+//One emulated frame: the instruction batch (the timers tick inside it, on
+//the emulated clock), the beeper and the per-frame exports. Returns the
+//debugger's stop reason when the batch was cut short for the prompt
+static const char *emulate_frame(emu_t *emu)
+{
+    chip8_t *chip8 = emu->chip8;
+    const char *stop = NULL;
+
+    if (emu->movie != NULL && !movie_frame(emu->movie, chip8))
+    {
+        return NULL;
+    }
+
+    const uint64_t start = (emu->telemetry != NULL) ? SDL_GetPerformanceCounter() : 0;
+
+    if (emu->debugger != NULL && debugger_armed(emu->debugger))
+    {
+        stop = debugger_run(emu->debugger, chip8, inst_per_frame(chip8));
+    }
+    else
+    {
+        run_instructions(chip8, inst_per_frame(chip8));
+    }
+
+    if (emu->telemetry != NULL)
+    {
+        telemetry_record(emu->telemetry, STAGE_BATCH, SDL_GetPerformanceCounter() - start);
+    }
+
+    if (emu->sdl != NULL)
+    {
+        update_audio(chip8, emu->sdl);
+    }
+
+    if (emu->frames != NULL && emu->runahead > 0)
+    {
+        //Run-ahead: the copy is the snapshot, and dropping it is the restore.
+        //Frames that react to input a frame or two late show the reaction now
+        emu->ahead = *chip8;
+        for (uint8_t i = 0; i < emu->runahead && emu->ahead.state != QUIT; i++)
+        {
+            run_frame(&emu->ahead);
+        }
+        tribuf_publish(emu->frames, &emu->ahead, emu->frame);
+        chip8->draw_flag = false;
+    }
+    else if (chip8->draw_flag)
+    {
+        if (emu->frames != NULL)
+        {
+            tribuf_publish(emu->frames, chip8, emu->frame);
+        }
+        chip8->draw_flag = false;
+    }
+
+    if (emu->shm != NULL)
+    {
+        if (emu->frames != NULL)
+        {
+            shm_export_stats(emu->shm, emu->frames->published, __atomic_load_n(&emu->presented, __ATOMIC_RELAXED));
+        }
+        shm_export_publish(emu->shm, chip8, emu->frame);
+    }
+
+    if (emu->capture != NULL)
+    {
+        capture_frame(emu->capture, chip8);
+    }
+    emu->frame++;
+
+    return stop;
+}
+
+//Keeps its own 60 Hz schedule against the performance counter, so a slow
+//present on the main thread never delays instructions or timers
+static int emulation_thread(void *data)
+{
+    emu_t *emu = data;
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    const uint64_t period = freq / 60;
+    uint64_t deadline = SDL_GetPerformanceCounter();
+    bool quit = false;
+
+    while (!quit)
+    {
+        const char *stop = NULL;
+
+        SDL_LockMutex(emu->lock);
+        for (uint8_t i = 0; i < emu->speed && emu->chip8->state == RUNNING && stop == NULL; i++)
+        {
+            stop = emulate_frame(emu);
+        }
+        if (stop != NULL)
+        {
+            emu->stopped = *emu->chip8;
+        }
+        quit = (emu->chip8->state == QUIT);
+        SDL_UnlockMutex(emu->lock);
+
+        //The prompt waits on the terminal for as long as the user likes, so it
+        //runs on the copy with the lock released and the window keeps pumping events
+        if (stop != NULL && !debugger_prompt(emu->debugger, &emu->stopped, stop))
+        {
+            SDL_LockMutex(emu->lock);
+            emu->chip8->state = QUIT;
+            SDL_UnlockMutex(emu->lock);
+            quit = true;
+        }
+
+        deadline += period;
+        const uint64_t now = SDL_GetPerformanceCounter();
+        __atomic_store_n(&emu->deadline, deadline, __ATOMIC_RELAXED);
+        __atomic_store_n(&emu->behind, now > deadline, __ATOMIC_RELAXED);
+
+        if (now < deadline)
+        {
+            SDL_Delay((uint32_t)((deadline - now) * 1000 / freq));
+
+            if (emu->telemetry != NULL)
+            {
+                const uint64_t woke = SDL_GetPerformanceCounter();
+                telemetry_record(emu->telemetry, STAGE_OVERSHOOT, woke > deadline ? woke - deadline : 0);
+            }
+        }
+        else if (now - deadline > (emu->frameskip ? 60 : 4) * period)
+        {
+            deadline = now;         //Back from a pause or the debugger, don't race to catch up
+        }
     }
 
-    const char *rom_file = argv[1];
-    const char *mod = (argc == 3) ? argv[2] : "CHIP8";
+    return 0;
+}
 
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0)
+//Rewrites the --stats file about once a second
+static void write_stats(const options_t *opt, const telemetry_t *telemetry, uint64_t *next)
+{
+    if (opt->stats_path == NULL)
+    {
+        return;
+    }
+
+    const uint64_t now = SDL_GetPerformanceCounter();
+    if (now >= *next)
+    {
+        telemetry_write(telemetry, opt->stats_path);
+        *next = now + telemetry->freq;
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    options_t opt = {0};
+    parse_args(argc, argv, &opt);
+
+    if (!opt.headless && SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0)
     {
         fprintf(stderr, "Error initializing SDL: %s\n", SDL_GetError());
         exit(EXIT_FAILURE);
@@ -21,46 +397,232 @@ int main(int argc, char const *argv[])
     chip8_t chip8 = {0};
     sdl_t sdl = {0};
 
-    system_init(&chip8, mod);
-    load_rom(&chip8, rom_file);
-    window_init(&sdl);
-    window_clear(&sdl);
-    audio_init(&sdl);
-
     srand(time(NULL));
 
-    uint16_t inst_per_sec = chip8.mod.CHIP ? 700 : 1200;
+    movie_t *movie = NULL;
+    if (opt.record_path != NULL && opt.replay_path != NULL)
+    {
+        usage(argv[0]);
+    }
+    else if (opt.record_path != NULL)
+    {
+        movie = movie_record(opt.record_path);
+    }
+    else if (opt.replay_path != NULL)
+    {
+        movie = movie_replay(opt.replay_path);
+        if (movie != NULL)
+        {
+            opt.mod = movie_mod(movie);
+        }
+    }
+
+    if ((movie == NULL && (opt.record_path != NULL || opt.replay_path != NULL)) ||
+        !system_init(&chip8, opt.mod) || !load_rom(&chip8, opt.rom_file) ||
+        (movie != NULL && !movie_start(movie, &chip8)))
+    {
+        SDL_Quit();
+        exit(EXIT_FAILURE);
+    }
+
+    //Resets restore this in memory instead of reloading the ROM file
+    static chip8_t boot;
+    boot = chip8;
+
+    if (!opt.headless)
+    {
+        scaler_init(&sdl.scaler, opt.filter, opt.palette[0], opt.palette[1], opt.scanlines, opt.phosphor);
+        window_init(&sdl, opt.width, opt.height);
+        window_clear(&sdl);
+        audio_init(&sdl);
+#ifdef CHIP8_HEATMAP
+        heatmap_window_init(&sdl);
+#endif
+    }
+
+    static debugger_t debugger;
+    static tribuf_t frames;
+    static telemetry_t telemetry;
+    uint64_t next_stats = 0;
+    emu_t emu = {.chip8 = &chip8, .movie = movie};
+
+    if (opt.timing)
+    {
+        telemetry_init(&telemetry, SDL_GetPerformanceFrequency());
+        emu.telemetry = &telemetry;
+    }
+
+    if (opt.shm_name != NULL)
+    {
+        emu.shm = shm_export_open(opt.shm_name);
+        if (emu.shm == NULL)
+        {
+            SDL_Quit();
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    while (chip8.state != QUIT)
+    if (opt.capture_path != NULL)
     {
-        do
+        emu.capture = capture_open(opt.capture_path, &chip8, opt.capture_scale, opt.capture_dedup);
+        if (emu.capture == NULL)
         {
-            keyboard(&chip8, mod, rom_file);
-        } while (chip8.state == PAUSED);
+            SDL_Quit();
+            exit(EXIT_FAILURE);
+        }
+    }
 
-        size_t start_perf = SDL_GetPerformanceFrequency();
+    if (opt.debug)
+    {
+        debugger_init(&debugger);
+        emu.debugger = &debugger;
+    }
 
-        for (uint8_t i = 0; i < inst_per_sec / 60; i++)
+    if (opt.headless)
+    {
+        while (chip8.state != QUIT && (opt.frames == 0 || emu.frame < opt.frames))
         {
-            instruction_execution(&chip8);
-            // db_instruction_execution(&chip8);
+            const char *stop = emulate_frame(&emu);
+            if (stop != NULL && !debugger_prompt(emu.debugger, &chip8, stop))
+            {
+                chip8.state = QUIT;
+            }
+            write_stats(&opt, &telemetry, &next_stats);
         }
+    }
+    else
+    {
+        //Input and rendering stay on this thread, as SDL wants
+        tribuf_init(&frames);
+        emu.sdl = &sdl;
+        emu.frames = &frames;
+        emu.lock = SDL_CreateMutex();
+        emu.frameskip = opt.frameskip;
+        emu.runahead = opt.runahead;
+        emu.speed = opt.speed;
+
+        SDL_Thread *thread = SDL_CreateThread(emulation_thread, "emulation", &emu);
+        const tribuf_frame_t *pending = NULL;
+        const uint64_t period = SDL_GetPerformanceFrequency() / 60;
+        uint64_t render_cost = 0;
+        uint8_t skipped = 0;
+        bool running = true;
+
+        while (running)
+        {
+            SDL_LockMutex(emu.lock);
+            const uint64_t polled = SDL_GetPerformanceCounter();
+            const bool reset = keyboard(&chip8, &boot);
+            if (reset && emu.movie != NULL && chip8.state != QUIT)
+            {
+                movie_reset(emu.movie, &chip8);
+            }
+            if (emu.telemetry != NULL)
+            {
+                telemetry_record(&telemetry, STAGE_INPUT, SDL_GetPerformanceCounter() - polled);
+            }
+            running = (chip8.state != QUIT);
+            SDL_UnlockMutex(emu.lock);
+
+            const tribuf_frame_t *latest = tribuf_acquire(&frames);
+            if (latest != NULL)
+            {
+                if (pending != NULL)
+                {
+                    skipped++;
+                }
+                pending = latest;
+            }
 
-        size_t end_perf = SDL_GetPerformanceFrequency();
+            //With --frameskip a present waits while the emulation thread is behind
+            //schedule, or while it would still be running when the next frame is
+            //due; a newer screen replaces it in the meantime
+            const uint64_t start = SDL_GetPerformanceCounter();
+            const bool overrun = render_cost < period &&
+                                 start + render_cost > __atomic_load_n(&emu.deadline, __ATOMIC_RELAXED);
+            const bool late = opt.frameskip && skipped < MAX_SKIPPED &&
+                              (overrun || __atomic_load_n(&emu.behind, __ATOMIC_RELAXED));
 
-        const double elapsed_time = (double)((end_perf - start_perf) * 1000) / SDL_GetPerformanceFrequency();
+            if (pending != NULL && !late)
+            {
+                PERF_SAMPLE(perf);
+                PERF_BEGIN(perf);
+                window_print(&sdl, pending->gfx, pending->lores);
+                const uint64_t drawn = SDL_GetPerformanceCounter();
+                window_present(&sdl);
+                const uint64_t shown = SDL_GetPerformanceCounter();
+                PERF_END(REGION_RENDER, perf);
+                __atomic_store_n(&emu.presented, emu.presented + 1, __ATOMIC_RELAXED);
+#ifdef CHIP8_HEATMAP
+                //15 Hz is plenty for a map of totals
+                if (emu.presented % 4 == 0)
+                {
+                    heatmap_window_print(&sdl);
+                }
+#endif
 
-        SDL_Delay(16.666f > elapsed_time ? 16.666f - elapsed_time : 0);
-        
-        if (chip8.draw_flag)
+                if (emu.telemetry != NULL)
+                {
+                    telemetry_record(&telemetry, STAGE_DRAW, drawn - start);
+                    telemetry_record(&telemetry, STAGE_PRESENT, shown - drawn);
+                }
+
+                render_cost = (3 * render_cost + (shown - start)) / 4;
+                pending = NULL;
+                skipped = 0;
+            }
+            else
+            {
+                SDL_Delay(1);
+            }
+
+            write_stats(&opt, &telemetry, &next_stats);
+        }
+
+        if (opt.frameskip && frames.published > 0)
         {
-            window_print(&sdl, &chip8);
-            chip8.draw_flag = false;
+            printf("Presented %llu of %llu screens (%.1f%% skipped)\n", (unsigned long long)emu.presented,
+                   (unsigned long long)frames.published, 100.0 * (frames.published - emu.presented) / frames.published);
         }
 
-        update_timer(&chip8, &sdl);
+        SDL_WaitThread(thread, NULL);
+        SDL_DestroyMutex(emu.lock);
+    }
+
+    if (emu.telemetry != NULL)
+    {
+        telemetry_print(&telemetry, stdout);
+        if (opt.stats_path != NULL)
+        {
+            telemetry_write(&telemetry, opt.stats_path);
+        }
     }
-    
+
+    PERF_REPORT(stdout);
+
+#ifdef CHIP8_HEATMAP
+    heatmap_summary(stdout);
+    if (opt.heatmap_path != NULL)
+    {
+        heatmap_write(opt.heatmap_path);
+    }
+#endif
+
+    if (emu.movie != NULL)
+    {
+        movie_close(emu.movie);
+    }
+
+    if (emu.capture != NULL)
+    {
+        capture_close(emu.capture);
+    }
+
+    if (emu.shm != NULL)
+    {
+        shm_export_close(emu.shm, opt.shm_name);
+    }
+
     SDL_Quit();
     return 0;
 }
@@ -0,0 +1,290 @@
+#include "movie.h"
+
+static const char *const variant_mods[3] = {"CHIP8", "-s", "-xo"};
+
+static uint64_t ram_hash(const chip8_t *chip8)
+{
+    uint64_t hash = 0xCBF29CE484222325;
+
+    for (uint16_t i = 0; i < RAM_SIZE; i++)
+    {
+        hash = (hash ^ chip8->ram[i]) * 0x100000001B3;
+    }
+
+    return hash;
+}
+
+static uint8_t variant_of(const chip8_t *chip8)
+{
+    return chip8->mod.SUPERCHIP ? 1 : chip8->mod.XOCHIP ? 2 : 0;
+}
+
+static void write_le(FILE *file, uint64_t value, uint8_t bytes)
+{
+    for (uint8_t i = 0; i < bytes; i++)
+    {
+        fputc((value >> (8 * i)) & 0xFF, file);
+    }
+}
+
+static bool read_le(FILE *file, uint64_t *value, uint8_t bytes)
+{
+    *value = 0;
+    for (uint8_t i = 0; i < bytes; i++)
+    {
+        const int c = fgetc(file);
+        if (c == EOF)
+        {
+            return false;
+        }
+        *value |= (uint64_t)c << (8 * i);
+    }
+
+    return true;
+}
+
+static void write_event(movie_t *movie, movie_event_t type, uint32_t value)
+{
+    uint64_t tag = ((uint64_t)(movie->frame - movie->last) << 2) | type;
+
+    do
+    {
+        fputc((tag & 0x7F) | (tag > 0x7F ? 0x80 : 0), movie->file);
+        tag >>= 7;
+    } while (tag > 0);
+
+    if (type == MOVIE_KEYS)
+    {
+        write_le(movie->file, value, 2);
+    }
+    else if (type == MOVIE_RESET)
+    {
+        write_le(movie->file, value, 4);
+    }
+
+    movie->last = movie->frame;
+}
+
+//A truncated file (the recorder was killed) just ends at its last event
+static void read_event(movie_t *movie)
+{
+    uint64_t tag = 0;
+    uint64_t value = 0;
+    int c;
+
+    for (uint8_t shift = 0; shift < 64; shift += 7)
+    {
+        c = fgetc(movie->file);
+        if (c == EOF)
+        {
+            break;
+        }
+        tag |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+        {
+            break;
+        }
+    }
+
+    movie->next_type = (c == EOF) ? MOVIE_END : (movie_event_t)(tag & 3);
+    movie->next_frame = movie->last + (uint32_t)((c == EOF) ? 0 : tag >> 2);
+
+    if ((movie->next_type == MOVIE_KEYS && !read_le(movie->file, &value, 2)) ||
+        (movie->next_type == MOVIE_RESET && !read_le(movie->file, &value, 4)) ||
+        movie->next_type > MOVIE_END)
+    {
+        movie->next_type = MOVIE_END;
+    }
+
+    movie->next_value = (uint32_t)value;
+    movie->last = movie->next_frame;
+}
+
+movie_t *movie_record(const char *path)
+{
+    movie_t *movie = calloc(1, sizeof(movie_t));
+    if (movie == NULL)
+    {
+        return NULL;
+    }
+
+    movie->file = fopen(path, "wb");
+    if (movie->file == NULL)
+    {
+        fprintf(stderr, "Error creating movie: %s\n", path);
+        free(movie);
+        return NULL;
+    }
+
+    return movie;
+}
+
+//Reads the header only; the variant it names has to be set up before movie_start
+movie_t *movie_replay(const char *path)
+{
+    movie_t *movie = calloc(1, sizeof(movie_t));
+    if (movie == NULL)
+    {
+        return NULL;
+    }
+
+    movie->replay = true;
+    movie->file = fopen(path, "rb");
+    if (movie->file == NULL)
+    {
+        fprintf(stderr, "Error opening movie: %s\n", path);
+        free(movie);
+        return NULL;
+    }
+
+    char magic[4];
+    uint64_t version, variant, seed;
+
+    if (fread(magic, 1, 4, movie->file) != 4 || memcmp(magic, MOVIE_MAGIC, 4) != 0 ||
+        !read_le(movie->file, &version, 1) || version != MOVIE_VERSION ||
+        !read_le(movie->file, &variant, 1) || variant > 2 ||
+        !read_le(movie->file, &seed, 4) || !read_le(movie->file, &movie->hash, 8))
+    {
+        fprintf(stderr, "Not a version %d movie: %s\n", MOVIE_VERSION, path);
+        fclose(movie->file);
+        free(movie);
+        return NULL;
+    }
+
+    movie->variant = (uint8_t)variant;
+    movie->seed = (uint32_t)seed;
+    movie->events = ftell(movie->file);
+    return movie;
+}
+
+//Mode argument for system_init that matches a replayed movie
+const char *movie_mod(const movie_t *movie)
+{
+    return variant_mods[movie->variant];
+}
+
+//Called once the ROM is loaded. Recording writes the header; replay checks
+//the ROM matches. Either way the machine gets the movie's seed
+bool movie_start(movie_t *movie, chip8_t *chip8)
+{
+    if (movie->replay)
+    {
+        if (variant_of(chip8) != movie->variant || ram_hash(chip8) != movie->hash)
+        {
+            fprintf(stderr, "Movie was recorded with a different ROM or mode\n");
+            return false;
+        }
+    }
+    else
+    {
+        movie->variant = variant_of(chip8);
+        movie->seed = (uint32_t)rand();
+        movie->hash = ram_hash(chip8);
+
+        fwrite(MOVIE_MAGIC, 1, 4, movie->file);
+        write_le(movie->file, MOVIE_VERSION, 1);
+        write_le(movie->file, movie->variant, 1);
+        write_le(movie->file, movie->seed, 4);
+        write_le(movie->file, movie->hash, 8);
+    }
+
+    seed_rng(chip8, movie->seed);
+    movie->initial = *chip8;
+    movie->frame = 0;
+    movie->last = 0;
+    movie->keys = 0;
+
+    if (movie->replay)
+    {
+        read_event(movie);
+    }
+
+    return true;
+}
+
+//Called before every emulated frame. Recording notes keypad changes; replay
+//applies the events due and overrides the live keypad. Returns false, with
+//the machine set to QUIT, once a replay is over
+bool movie_frame(movie_t *movie, chip8_t *chip8)
+{
+    if (!movie->replay)
+    {
+        uint16_t keys = 0;
+        for (uint8_t i = 0; i < NUM_KEYS; i++)
+        {
+            keys |= chip8->keyboard[i] << i;
+        }
+
+        if (keys != movie->keys)
+        {
+            write_event(movie, MOVIE_KEYS, keys);
+            movie->keys = keys;
+        }
+
+        movie->frame++;
+        return true;
+    }
+
+    while (movie->next_frame == movie->frame)
+    {
+        if (movie->next_type == MOVIE_END)
+        {
+            chip8->state = QUIT;
+            return false;
+        }
+
+        if (movie->next_type == MOVIE_RESET)
+        {
+            system_reset(chip8, &movie->initial);
+            seed_rng(chip8, movie->next_value);
+            movie->keys = 0;
+        }
+        else
+        {
+            movie->keys = (uint16_t)movie->next_value;
+        }
+
+        read_event(movie);
+    }
+
+    for (uint8_t i = 0; i < NUM_KEYS; i++)
+    {
+        chip8->keyboard[i] = (movie->keys >> i) & 1;
+    }
+
+    movie->frame++;
+    return true;
+}
+
+//The user reset the machine (it has just been reloaded). A recording notes
+//it with a fresh seed; a replay starts over
+void movie_reset(movie_t *movie, chip8_t *chip8)
+{
+    if (!movie->replay)
+    {
+        const uint32_t seed = (uint32_t)rand();
+
+        seed_rng(chip8, seed);
+        write_event(movie, MOVIE_RESET, seed);
+        movie->keys = 0;
+        return;
+    }
+
+    fseek(movie->file, movie->events, SEEK_SET);
+    seed_rng(chip8, movie->seed);
+    movie->frame = 0;
+    movie->last = 0;
+    movie->keys = 0;
+    read_event(movie);
+}
+
+void movie_close(movie_t *movie)
+{
+    if (!movie->replay)
+    {
+        write_event(movie, MOVIE_END, 0);
+    }
+
+    fclose(movie->file);
+    free(movie);
+}
@@ -0,0 +1,54 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "chip8.h"
+
+#define MOVIE_MAGIC "C8MV"
+#define MOVIE_VERSION 1
+
+//Input movie: everything needed to rerun a session bit-exactly. Keys only
+//change between frames (input is handled under the frame lock), so events
+//are stamped with the index of the frame they apply before.
+//
+//    "C8MV" u8 version, u8 variant (0 CHIP-8, 1 SUPERCHIP, 2 XO-CHIP),
+//    u32 seed, u64 FNV-1a of RAM after loading the ROM
+//    events: LEB128 (frame delta << 2 | type), then
+//        MOVIE_KEYS   u16 keypad mask
+//        MOVIE_RESET  u32 new seed, the machine restarts from the loaded ROM
+//        MOVIE_END    nothing, the session ended before this frame
+//
+//All integers little-endian.
+
+typedef enum {
+    MOVIE_KEYS,
+    MOVIE_RESET,
+    MOVIE_END
+} movie_event_t;
+
+typedef struct {
+    FILE *file;
+    bool replay;
+    uint8_t variant;
+    uint32_t seed;
+    uint64_t hash;
+    long events;                    //File offset of the first event
+    uint32_t frame;                 //Frames run since the start or the last rewind
+    uint32_t last;                  //Frame of the previous event
+    uint16_t keys;                  //Keypad mask in effect
+    chip8_t initial;                //Machine as loaded, restored by replayed resets
+
+    //Replay: the event that comes next
+    movie_event_t next_type;
+    uint32_t next_frame;
+    uint32_t next_value;
+} movie_t;
+
+movie_t *movie_record(const char *path);
+movie_t *movie_replay(const char *path);
+const char *movie_mod(const movie_t *movie);
+bool movie_start(movie_t *movie, chip8_t *chip8);
+bool movie_frame(movie_t *movie, chip8_t *chip8);
+void movie_reset(movie_t *movie, chip8_t *chip8);
+void movie_close(movie_t *movie);
+
+#endif
@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <time.h>
+#include <stdbool.h>
+#include "perfcount.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+typedef struct {
+    uint64_t calls;
+    uint64_t ns;
+    uint64_t counts[NUM_COUNTERS];
+    uint64_t counted;                   //Calls that had hardware counters
+    uint8_t available;                  //Bit per counter that was open for them
+} perf_total_t;
+
+static const char *const region_names[NUM_REGIONS] = {
+    "dispatch", "sprite", "scroll", "render", "audio"
+};
+
+//Each region is only ever entered from one thread, so the totals need no locking
+static perf_total_t totals[NUM_REGIONS];
+
+//Counters count the thread that opened them, so every thread gets its own
+//group, opened on its first region. -2 not tried yet, -1 unavailable
+static __thread int group_fd = -2;
+static __thread int8_t slots[NUM_COUNTERS];     //Position in the group read, -1 if not open
+
+#ifdef __linux__
+static int open_counter(uint32_t type, uint64_t config, int leader)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+static void open_group(void)
+{
+    static const struct {
+        uint32_t type;
+        uint64_t config;
+    } events[NUM_COUNTERS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}
+    };
+    int8_t opened = 0;
+
+    group_fd = -1;
+    for (uint8_t i = 0; i < NUM_COUNTERS; i++)
+    {
+        const int fd = open_counter(events[i].type, events[i].config, group_fd);
+
+        slots[i] = -1;
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        if (group_fd < 0)
+        {
+            group_fd = fd;
+        }
+        slots[i] = opened++;
+    }
+
+    static bool warned = false;
+    if (group_fd < 0 && !__atomic_exchange_n(&warned, true, __ATOMIC_RELAXED))
+    {
+        fprintf(stderr, "perf_event_open unavailable, timing regions only\n");
+    }
+}
+
+static void read_group(perf_sample_t *sample)
+{
+    uint64_t values[1 + NUM_COUNTERS];
+
+    if (group_fd < 0 || read(group_fd, values, sizeof(values)) <= 0)
+    {
+        return;
+    }
+
+    for (uint8_t i = 0; i < NUM_COUNTERS; i++)
+    {
+        sample->counts[i] = (slots[i] >= 0) ? values[1 + slots[i]] : 0;
+    }
+}
+#else
+static void open_group(void)
+{
+    group_fd = -1;
+    memset(slots, -1, sizeof(slots));
+}
+
+static void read_group(perf_sample_t *sample)
+{
+    (void)sample;
+}
+#endif
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void perf_begin(perf_sample_t *sample)
+{
+    if (group_fd == -2)
+    {
+        open_group();
+    }
+
+    memset(sample->counts, 0, sizeof(sample->counts));
+    sample->ns = now_ns();
+    read_group(sample);
+}
+
+void perf_end(perf_region_t region, const perf_sample_t *start)
+{
+    perf_sample_t end = {0};
+    perf_total_t *total = &totals[region];
+
+    read_group(&end);
+    end.ns = now_ns();
+
+    total->calls++;
+    total->ns += end.ns - start->ns;
+    if (group_fd >= 0)
+    {
+        for (uint8_t i = 0; i < NUM_COUNTERS; i++)
+        {
+            total->counts[i] += end.counts[i] - start->counts[i];
+            if (slots[i] >= 0)
+            {
+                total->available |= 1 << i;
+            }
+        }
+        total->counted++;
+    }
+}
+
+//Per-call averages; counters that could not be opened print as '-'
+void perf_report(FILE *out)
+{
+    static const char *const counter_names[NUM_COUNTERS] = {
+        "cycles", "insts", "br-miss", "l1d-miss"
+    };
+
+    fprintf(out, "%-10s %10s %10s", "region", "calls", "ns/call");
+    for (uint8_t i = 0; i < NUM_COUNTERS; i++)
+    {
+        fprintf(out, " %10s", counter_names[i]);
+    }
+    fprintf(out, " %6s\n", "IPC");
+
+    for (uint8_t r = 0; r < NUM_REGIONS; r++)
+    {
+        const perf_total_t *total = &totals[r];
+
+        if (total->calls == 0)
+        {
+            continue;
+        }
+
+        fprintf(out, "%-10s %10llu %10.1f", region_names[r], (unsigned long long)total->calls,
+                (double)total->ns / total->calls);
+
+        for (uint8_t i = 0; i < NUM_COUNTERS; i++)
+        {
+            if (total->available & (1 << i))
+            {
+                fprintf(out, " %10.1f", (double)total->counts[i] / total->counted);
+            }
+            else
+            {
+                fprintf(out, " %10s", "-");
+            }
+        }
+
+        if (total->counts[COUNTER_CYCLES] > 0 && (total->available & (1 << COUNTER_INSTRUCTIONS)))
+        {
+            fprintf(out, " %6.2f\n", (double)total->counts[COUNTER_INSTRUCTIONS] / total->counts[COUNTER_CYCLES]);
+        }
+        else
+        {
+            fprintf(out, " %6s\n", "-");
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+//Hardware counters around named regions, compiled in only with -DCHIP8_PERF
+//('make perf' builds chip8-perf). Without it every macro below is empty.
+
+typedef enum {
+    REGION_DISPATCH,                    //A whole run_batch, sprites and scrolls included
+    REGION_SPRITE,                      //DXYN
+    REGION_SCROLL,                      //00CN, 00FB, 00FC
+    REGION_RENDER,                      //window_print and window_present
+    REGION_AUDIO,                       //The SDL audio callback
+    NUM_REGIONS
+} perf_region_t;
+
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_L1D_MISSES,
+    NUM_COUNTERS
+} perf_counter_t;
+
+typedef struct {
+    uint64_t ns;
+    uint64_t counts[NUM_COUNTERS];
+} perf_sample_t;
+
+#ifdef CHIP8_PERF
+void perf_begin(perf_sample_t *sample);
+void perf_end(perf_region_t region, const perf_sample_t *start);
+void perf_report(FILE *out);
+
+#define PERF_SAMPLE(name) perf_sample_t name
+#define PERF_BEGIN(name) perf_begin(&name)
+#define PERF_END(region, name) perf_end(region, &name)
+#define PERF_REPORT(out) perf_report(out)
+#else
+#define PERF_SAMPLE(name)
+#define PERF_BEGIN(name)
+#define PERF_END(region, name)
+#define PERF_REPORT(out)
+#endif
+
+#endif
@@ -0,0 +1,371 @@
+#define _POSIX_C_SOURCE 200809L
+#include "capture.h"
+#include <dirent.h>
+
+//Runs every <name>.ch8 in a directory headless against its <name>.golden script:
+//
+//    mode -s                   Variant flag, as on the emulator command line
+//    seed 1234                 RNG seed for CXNN
+//    frames 600                Frames to run (defaults to the last check)
+//    key 120 0010              From frame 120 on, hold the keys in this hex mask
+//    check 300 9f2c...         Hash of gfx + registers after frame 300
+//
+//With --update the hashes are (re)written and <name>.<frame>.png records the
+//expected screen. Commit it with the .golden: on a mismatch
+//<name>.<frame>.actual.png is written beside it for comparison.
+
+#define MAX_CASES 1024
+#define MAX_KEY_EVENTS 256
+#define MAX_CHECKS 64
+
+typedef struct {
+    uint64_t frame;
+    uint16_t mask;
+} key_event_t;
+
+typedef struct {
+    uint64_t frame;
+    uint64_t expected;
+    uint64_t actual;
+    bool has_expected;
+} checkpoint_t;
+
+typedef struct {
+    char base[FILENAME_MAX];            //Path without the .ch8 extension
+    char mod[8];
+    uint32_t seed;
+    uint64_t frames;
+    key_event_t keys[MAX_KEY_EVENTS];
+    uint16_t num_keys;
+    checkpoint_t checks[MAX_CHECKS];
+    uint16_t num_checks;
+    bool failed;
+    bool error;
+} test_case_t;
+
+typedef struct {
+    test_case_t *cases;
+    uint16_t count;
+    uint16_t next;
+    bool update;
+    SDL_mutex *lock;
+} suite_t;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001B3;
+    }
+
+    return hash;
+}
+
+static uint64_t state_hash(const chip8_t *chip8)
+{
+    uint64_t hash = 0xCBF29CE484222325;
+    uint8_t gfx[SCREEN_WIDTH_S * SCREEN_HEIGHT_S];
+
+    //Hash what is shown, not how it is stored
+    gfx_output(chip8, gfx);
+    hash = fnv1a(hash, gfx, sizeof(gfx));
+    hash = fnv1a(hash, chip8->V, sizeof(chip8->V));
+    hash = fnv1a(hash, chip8->stack, sizeof(chip8->stack));
+    hash = fnv1a(hash, &chip8->I, sizeof(chip8->I));
+    hash = fnv1a(hash, &chip8->PC, sizeof(chip8->PC));
+    hash = fnv1a(hash, &chip8->SP, sizeof(chip8->SP));
+    hash = fnv1a(hash, &chip8->delay_timer, sizeof(chip8->delay_timer));
+    hash = fnv1a(hash, &chip8->sound_timer, sizeof(chip8->sound_timer));
+
+    return hash;
+}
+
+static bool parse_golden(test_case_t *tc)
+{
+    char path[FILENAME_MAX + 8];
+    char line[256];
+
+    snprintf(path, sizeof(path), "%s.golden", tc->base);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file: %s\n", path);
+        return false;
+    }
+
+    strcpy(tc->mod, "CHIP8");
+    tc->seed = 1;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char word[16] = {0};
+        char arg[32] = {0};
+        unsigned long long frame = 0;
+        unsigned long long value = 0;
+
+        if (line[0] == '#' || sscanf(line, "%15s", word) != 1)
+        {
+            continue;
+        }
+
+        if (strcmp(word, "mode") == 0 && sscanf(line, "%*s %31s", arg) == 1)
+        {
+            snprintf(tc->mod, sizeof(tc->mod), "%s", arg);
+        }
+        else if (strcmp(word, "seed") == 0 && sscanf(line, "%*s %llu", &value) == 1)
+        {
+            tc->seed = value;
+        }
+        else if (strcmp(word, "frames") == 0 && sscanf(line, "%*s %llu", &value) == 1)
+        {
+            tc->frames = value;
+        }
+        else if (strcmp(word, "key") == 0 && sscanf(line, "%*s %llu %llx", &frame, &value) == 2 &&
+                 tc->num_keys < MAX_KEY_EVENTS)
+        {
+            tc->keys[tc->num_keys++] = (key_event_t){.frame = frame, .mask = value};
+        }
+        else if (strcmp(word, "check") == 0 && sscanf(line, "%*s %llu", &frame) == 1 &&
+                 tc->num_checks < MAX_CHECKS)
+        {
+            checkpoint_t *check = &tc->checks[tc->num_checks++];
+            check->frame = frame;
+            check->has_expected = (sscanf(line, "%*s %*u %31s", arg) == 1);
+            check->expected = strtoull(arg, NULL, 16);
+
+            if (frame > tc->frames)
+            {
+                tc->frames = frame;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "%s: cannot parse: %s", path, line);
+            fclose(file);
+            return false;
+        }
+    }
+
+    fclose(file);
+
+    if (strcmp(tc->mod, "CHIP8") != 0 && strcmp(tc->mod, "-s") != 0 && strcmp(tc->mod, "-xo") != 0)
+    {
+        fprintf(stderr, "%s: unknown mode %s\n", path, tc->mod);
+        return false;
+    }
+
+    return true;
+}
+
+static bool write_golden(const test_case_t *tc)
+{
+    char path[FILENAME_MAX + 8];
+
+    snprintf(path, sizeof(path), "%s.golden", tc->base);
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file: %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "mode %s\nseed %u\nframes %llu\n", tc->mod, tc->seed, (unsigned long long)tc->frames);
+    for (uint16_t k = 0; k < tc->num_keys; k++)
+    {
+        fprintf(file, "key %llu %04X\n", (unsigned long long)tc->keys[k].frame, tc->keys[k].mask);
+    }
+    for (uint16_t c = 0; c < tc->num_checks; c++)
+    {
+        fprintf(file, "check %llu %016llx\n", (unsigned long long)tc->checks[c].frame,
+                (unsigned long long)tc->checks[c].actual);
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void dump_frame(const test_case_t *tc, const chip8_t *chip8, uint64_t frame, const char *suffix)
+{
+    char path[FILENAME_MAX + 40];
+    uint8_t gfx[SCREEN_WIDTH_S * SCREEN_HEIGHT_S];
+    uint8_t screen_width = (chip8->mod.CHIP) ? SCREEN_WIDTH : SCREEN_WIDTH_S;
+    uint8_t screen_height = (chip8->mod.CHIP) ? SCREEN_HEIGHT : SCREEN_HEIGHT_S;
+
+    snprintf(path, sizeof(path), "%s.%llu%s.png", tc->base, (unsigned long long)frame, suffix);
+    gfx_output(chip8, gfx);
+    png_write(path, gfx, screen_width, screen_height);
+}
+
+static void run_case(test_case_t *tc, bool update)
+{
+    chip8_t *chip8 = malloc(sizeof(chip8_t));
+    char rom[FILENAME_MAX + 8];
+    uint16_t next_key = 0;
+    uint16_t keys = 0;
+
+    snprintf(rom, sizeof(rom), "%s.ch8", tc->base);
+    if (!system_init(chip8, tc->mod) || !load_rom(chip8, rom))
+    {
+        tc->error = true;
+        free(chip8);
+        return;
+    }
+    seed_rng(chip8, tc->seed);
+
+    for (uint64_t frame = 0; frame < tc->frames; frame++)
+    {
+        while (next_key < tc->num_keys && tc->keys[next_key].frame <= frame)
+        {
+            keys = tc->keys[next_key++].mask;
+        }
+
+        for (uint8_t i = 0; i < NUM_KEYS; i++)
+        {
+            chip8->keyboard[i] = (keys >> i) & 1;
+        }
+
+        run_frame(chip8);
+
+        for (uint16_t c = 0; c < tc->num_checks; c++)
+        {
+            checkpoint_t *check = &tc->checks[c];
+            if (check->frame != frame + 1)
+            {
+                continue;
+            }
+
+            check->actual = state_hash(chip8);
+
+            if (update)
+            {
+                dump_frame(tc, chip8, check->frame, "");
+            }
+            else if (!check->has_expected || check->actual != check->expected)
+            {
+                tc->failed = true;
+                dump_frame(tc, chip8, check->frame, ".actual");
+            }
+        }
+    }
+
+    free(chip8);
+
+    if (update && !write_golden(tc))
+    {
+        tc->error = true;
+    }
+}
+
+static int worker(void *data)
+{
+    suite_t *suite = data;
+
+    for (;;)
+    {
+        SDL_LockMutex(suite->lock);
+        const uint16_t index = suite->next++;
+        SDL_UnlockMutex(suite->lock);
+
+        if (index >= suite->count)
+        {
+            break;
+        }
+
+        run_case(&suite->cases[index], suite->update);
+    }
+
+    return 0;
+}
+
+static int compare_cases(const void *a, const void *b)
+{
+    return strcmp(((const test_case_t *)a)->base, ((const test_case_t *)b)->base);
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 2 || argc > 3 || (argc == 3 && strcmp(argv[2], "--update") != 0))
+    {
+        fprintf(stderr, "Usage: %s <test-rom-dir> [--update]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    DIR *dir = opendir(argv[1]);
+    if (dir == NULL)
+    {
+        fprintf(stderr, "Error opening directory: %s\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    static test_case_t cases[MAX_CASES];
+    suite_t suite = {.cases = cases, .update = (argc == 3)};
+    struct dirent *entry;
+    bool broken = false;
+
+    while ((entry = readdir(dir)) != NULL && suite.count < MAX_CASES)
+    {
+        const size_t len = strlen(entry->d_name);
+        if (len <= 4 || strcmp(&entry->d_name[len - 4], ".ch8") != 0)
+        {
+            continue;
+        }
+
+        test_case_t *tc = &cases[suite.count];
+        snprintf(tc->base, sizeof(tc->base), "%s/%.*s", argv[1], (int)(len - 4), entry->d_name);
+
+        if (parse_golden(tc))
+        {
+            suite.count++;
+        }
+        else
+        {
+            memset(tc, 0, sizeof(test_case_t));
+            broken = true;
+        }
+    }
+    closedir(dir);
+
+    qsort(cases, suite.count, sizeof(test_case_t), compare_cases);
+
+    const int threads = SDL_GetCPUCount() > 0 ? SDL_GetCPUCount() : 1;
+    SDL_Thread *pool[64];
+    const int num_threads = (threads > 64) ? 64 : threads;
+
+    suite.lock = SDL_CreateMutex();
+    for (int t = 0; t < num_threads; t++)
+    {
+        pool[t] = SDL_CreateThread(worker, "regress", &suite);
+    }
+    for (int t = 0; t < num_threads; t++)
+    {
+        SDL_WaitThread(pool[t], NULL);
+    }
+    SDL_DestroyMutex(suite.lock);
+
+    uint16_t failures = 0;
+    for (uint16_t i = 0; i < suite.count; i++)
+    {
+        const test_case_t *tc = &cases[i];
+        const bool failed = tc->failed || tc->error;
+
+        printf("%-6s %s\n", suite.update ? "UPDATE" : (failed ? "FAIL" : "PASS"), tc->base);
+        for (uint16_t c = 0; c < tc->num_checks && failed; c++)
+        {
+            const checkpoint_t *check = &tc->checks[c];
+            if (!check->has_expected || check->actual != check->expected)
+            {
+                printf("       frame %llu: expected %016llx, got %016llx\n",
+                       (unsigned long long)check->frame, (unsigned long long)check->expected,
+                       (unsigned long long)check->actual);
+                printf("       compare %s.%llu.png with %s.%llu.actual.png\n", tc->base,
+                       (unsigned long long)check->frame, tc->base, (unsigned long long)check->frame);
+            }
+        }
+        failures += failed;
+    }
+
+    printf("%u cases, %u failed\n", suite.count, failures);
+    return (failures || broken) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
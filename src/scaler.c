@@ -0,0 +1,243 @@
+#include "scaler.h"
+
+//Eight pixels per store: one AVX register, two SSE/NEON ones, whatever the
+//target has. GCC lowers the vector type to the widest stores available
+#define PIXEL_VEC 8
+typedef uint32_t pixel_vec_t __attribute__((vector_size(PIXEL_VEC * 4)));
+
+static uint32_t blend(uint32_t background, uint32_t foreground, uint8_t level, uint8_t scale)
+{
+    uint32_t colour = 0xFF000000;
+
+    for (uint8_t shift = 0; shift < 24; shift += 8)
+    {
+        const int32_t bg = (background >> shift) & 0xFF;
+        const int32_t fg = (foreground >> shift) & 0xFF;
+        const int32_t value = bg + (fg - bg) * level / 255;
+
+        colour |= (uint32_t)(value * scale / 8) << shift;
+    }
+
+    return colour;
+}
+
+//Colours are 0xRRGGBB; decay is how much glow (out of 256) a pixel keeps
+//each screen after it goes dark
+void scaler_init(scaler_t *s, scaler_filter_t filter, uint32_t background, uint32_t foreground,
+                 bool scanlines, uint8_t decay)
+{
+    memset(s, 0, sizeof(scaler_t));
+    s->filter = filter;
+    s->scanlines = scanlines;
+    s->decay = decay;
+
+    for (uint16_t i = 0; i < 256; i++)
+    {
+        s->lut[i] = blend(background, foreground, i, 8);
+        s->dim[i] = blend(background, foreground, i, 5);
+    }
+}
+
+//AdvMAME2x/Scale2x: each pixel becomes 2x2, corners take a neighbour's value
+//where two neighbours meeting at that corner agree. Borders repeat the edge
+static void scale2x(const uint8_t *in, uint16_t width, uint16_t height, uint8_t *out)
+{
+    const uint16_t out_width = 2 * width;
+
+    for (uint16_t y = 0; y < height; y++)
+    {
+        const uint8_t *above = &in[(y > 0 ? y - 1 : y) * width];
+        const uint8_t *row = &in[y * width];
+        const uint8_t *below = &in[(y + 1 < height ? y + 1 : y) * width];
+        uint8_t *top = &out[2 * y * out_width];
+        uint8_t *bottom = top + out_width;
+
+        for (uint16_t x = 0; x < width; x++)
+        {
+            const uint8_t B = above[x];
+            const uint8_t D = row[x > 0 ? x - 1 : x];
+            const uint8_t E = row[x];
+            const uint8_t F = row[x + 1 < width ? x + 1 : x];
+            const uint8_t H = below[x];
+
+            if (B != H && D != F)
+            {
+                top[2 * x] = (D == B) ? D : E;
+                top[2 * x + 1] = (B == F) ? F : E;
+                bottom[2 * x] = (D == H) ? D : E;
+                bottom[2 * x + 1] = (H == F) ? F : E;
+            }
+            else
+            {
+                top[2 * x] = top[2 * x + 1] = E;
+                bottom[2 * x] = bottom[2 * x + 1] = E;
+            }
+        }
+    }
+}
+
+//AdvMAME3x/Scale3x, the same idea on a 3x3 block using all eight neighbours
+static void scale3x(const uint8_t *in, uint16_t width, uint16_t height, uint8_t *out)
+{
+    const uint16_t out_width = 3 * width;
+
+    for (uint16_t y = 0; y < height; y++)
+    {
+        const uint8_t *above = &in[(y > 0 ? y - 1 : y) * width];
+        const uint8_t *row = &in[y * width];
+        const uint8_t *below = &in[(y + 1 < height ? y + 1 : y) * width];
+        uint8_t *r0 = &out[3 * y * out_width];
+        uint8_t *r1 = r0 + out_width;
+        uint8_t *r2 = r1 + out_width;
+
+        for (uint16_t x = 0; x < width; x++)
+        {
+            const uint16_t l = x > 0 ? x - 1 : x;
+            const uint16_t r = x + 1 < width ? x + 1 : x;
+            const uint8_t A = above[l], B = above[x], C = above[r];
+            const uint8_t D = row[l], E = row[x], F = row[r];
+            const uint8_t G = below[l], H = below[x], I = below[r];
+
+            if (B != H && D != F)
+            {
+                r0[3 * x] = (D == B) ? D : E;
+                r0[3 * x + 1] = ((D == B && E != C) || (B == F && E != A)) ? B : E;
+                r0[3 * x + 2] = (B == F) ? F : E;
+                r1[3 * x] = ((D == B && E != G) || (D == H && E != A)) ? D : E;
+                r1[3 * x + 1] = E;
+                r1[3 * x + 2] = ((B == F && E != I) || (H == F && E != C)) ? F : E;
+                r2[3 * x] = (D == H) ? D : E;
+                r2[3 * x + 1] = ((D == H && E != I) || (H == F && E != G)) ? H : E;
+                r2[3 * x + 2] = (H == F) ? F : E;
+            }
+            else
+            {
+                r0[3 * x] = r0[3 * x + 1] = r0[3 * x + 2] = E;
+                r1[3 * x] = r1[3 * x + 1] = r1[3 * x + 2] = E;
+                r2[3 * x] = r2[3 * x + 1] = r2[3 * x + 2] = E;
+            }
+        }
+    }
+}
+
+static inline void fill(uint32_t *dst, uint32_t colour, uint32_t count)
+{
+    const pixel_vec_t splat = (pixel_vec_t){0} + colour;
+    uint32_t i = 0;
+
+    for (; i + PIXEL_VEC <= count; i += PIXEL_VEC)
+    {
+        memcpy(&dst[i], &splat, sizeof(splat));
+    }
+    for (; i < count; i++)
+    {
+        dst[i] = colour;
+    }
+}
+
+//One output row: left border, each source pixel repeated scale times, right border
+static void build_row(uint32_t *dst, const uint8_t *src, const uint32_t *lut, uint16_t columns,
+                      uint16_t scale, uint16_t left, uint16_t out_width)
+{
+    const uint32_t background = lut[0];
+
+    fill(dst, background, left);
+    dst += left;
+
+    for (uint16_t x = 0; x < columns; x++)
+    {
+        fill(dst, lut[src[x]], scale);
+        dst += scale;
+    }
+
+    fill(dst, background, out_width - left - columns * scale);
+}
+
+static inline uint32_t *out_row(uint32_t *out, size_t pitch, uint32_t y)
+{
+    return (uint32_t *)((uint8_t *)out + y * pitch);
+}
+
+//Draws a width x height screen centred in out at the largest integer scale
+//that fits; pitch is in bytes. Phosphor glow advances once per call
+void scaler_render(scaler_t *s, const uint8_t *gfx, uint16_t width, uint16_t height,
+                   uint32_t *out, size_t pitch, uint16_t out_width, uint16_t out_height)
+{
+    const uint32_t pixels = (uint32_t)width * height;
+
+    if (width != s->width || height != s->height)
+    {
+        memset(s->glow, 0, sizeof(s->glow));
+        s->width = width;
+        s->height = height;
+    }
+
+    for (uint32_t i = 0; i < pixels; i++)
+    {
+        const uint8_t faded = (s->glow[i] * s->decay) >> 8;
+        s->glow[i] = gfx[i] ? 255 : faded;
+    }
+
+    const uint8_t *src = s->glow;
+    uint16_t src_width = width;
+    uint16_t src_height = height;
+
+    if (s->filter == FILTER_SCALE2X)
+    {
+        scale2x(s->glow, width, height, s->smooth);
+        src = s->smooth;
+        src_width *= 2;
+        src_height *= 2;
+    }
+    else if (s->filter == FILTER_SCALE3X)
+    {
+        scale3x(s->glow, width, height, s->smooth);
+        src = s->smooth;
+        src_width *= 3;
+        src_height *= 3;
+    }
+
+    //Integer scale only; an output smaller than the source is clipped
+    uint16_t scale = out_width / src_width < out_height / src_height ? out_width / src_width : out_height / src_height;
+    if (scale == 0)
+    {
+        scale = 1;
+    }
+
+    const uint16_t columns = src_width * scale <= out_width ? src_width : out_width;
+    const uint16_t rows = src_height * scale <= out_height ? src_height : out_height;
+    const uint16_t left = (out_width - columns * scale) / 2;
+    const uint16_t top = (out_height - rows * scale) / 2;
+    const bool scanlines = s->scanlines && scale > 1;
+    const size_t row_bytes = (size_t)out_width * 4;
+    uint32_t y = 0;
+
+    for (; y < top; y++)
+    {
+        fill(out_row(out, pitch, y), s->lut[0], out_width);
+    }
+
+    //Each source row is expanded once, then copied down; the copies are
+    //plain memcpy and account for most of the bandwidth at 4K
+    for (uint16_t row = 0; row < rows; row++)
+    {
+        const uint8_t *line = &src[row * src_width];
+        const uint32_t *first = out_row(out, pitch, y);
+
+        build_row(out_row(out, pitch, y++), line, s->lut, columns, scale, left, out_width);
+        for (uint16_t i = 1; i < scale - scanlines; i++)
+        {
+            memcpy(out_row(out, pitch, y++), first, row_bytes);
+        }
+
+        if (scanlines)
+        {
+            build_row(out_row(out, pitch, y++), line, s->dim, columns, scale, left, out_width);
+        }
+    }
+
+    for (; y < out_height; y++)
+    {
+        fill(out_row(out, pitch, y), s->lut[0], out_width);
+    }
+}
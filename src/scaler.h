@@ -0,0 +1,35 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include "chip8.h"
+
+#define SCALER_MAX_FACTOR 3             //Largest ScaleNx pass
+
+typedef enum {
+    FILTER_NEAREST,
+    FILTER_SCALE2X,
+    FILTER_SCALE3X
+} scaler_filter_t;
+
+//CPU output stage: turns a 0/1 screen into ARGB8888 pixels of any size, with
+//an optional edge-smoothing pass, a two-colour palette, scanlines and
+//phosphor decay. Written for a locked streaming texture, so every output
+//pixel is stored each call and nothing is read back
+typedef struct {
+    scaler_filter_t filter;
+    bool scanlines;                     //Darken the last row of every scaled pixel
+    uint8_t decay;                      //Phosphor persistence per presented screen, 0 off
+    uint16_t width;                     //Screen size the glow buffer belongs to
+    uint16_t height;
+    uint32_t lut[256];                  //Glow level to colour, background to foreground
+    uint32_t dim[256];                  //The same on scanline rows
+    uint8_t glow[SCREEN_WIDTH_S * SCREEN_HEIGHT_S];
+    uint8_t smooth[SCREEN_WIDTH_S * SCREEN_HEIGHT_S * SCALER_MAX_FACTOR * SCALER_MAX_FACTOR];
+} scaler_t;
+
+void scaler_init(scaler_t *s, scaler_filter_t filter, uint32_t background, uint32_t foreground,
+                 bool scanlines, uint8_t decay);
+void scaler_render(scaler_t *s, const uint8_t *gfx, uint16_t width, uint16_t height,
+                   uint32_t *out, size_t pitch, uint16_t out_width, uint16_t out_height);
+
+#endif
@@ -0,0 +1,705 @@
+#define _POSIX_C_SOURCE 200809L
+#include "chip8.h"
+#include "disasm.h"
+#include <SDL2/SDL.h>
+#include <dirent.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+
+//Static analysis of ROMs, for sorting a corpus without running it. Code is
+//found by recursive descent from START_ADDRESS, one pass per function: the
+//entry point and every 2NNN target. Per ROM it reports
+//
+//    variant             "schip" if any SUPERCHIP opcode is reachable
+//    ops                 How many reachable instructions use each SUPERCHIP opcode
+//    functions           Entry, instructions reached from it, whether it returns,
+//                        and the functions it calls
+//    indirect_jumps      Addresses of BNNN, whose targets are not followed
+//    self_modifying      FX33/FX55 whose I is known from an ANNN on the way and
+//                        whose stores land on reached code
+//    unresolved_stores   FX33/FX55 where I came from arithmetic or a quirk
+//    cacheable           No indirect jumps, undefined opcodes, paths leaving the
+//                        ROM or stores that could reach code: the code seen is
+//                        all the code run
+//
+//Output is a JSON array with one object per line, sorted by path.
+
+#define MAX_FUNCTIONS (RAM_SIZE / 2)
+#define MAX_PENDING (2 * RAM_SIZE)
+
+//Per-address marks
+#define MARK_CODE 1                     //First byte of a reached instruction
+#define MARK_OPERAND 2                  //Second byte of one
+
+typedef enum {
+    OP_00CN,
+    OP_00FB,
+    OP_00FC,
+    OP_00FD,
+    OP_00FE,
+    OP_00FF,
+    OP_DXY0,
+    OP_FX30,
+    OP_FX75,
+    OP_FX85,
+    NUM_SCHIP_OPS
+} schip_op_t;
+
+static const char *const schip_names[NUM_SCHIP_OPS] = {
+    "00CN", "00FB", "00FC", "00FD", "00FE", "00FF", "DXY0", "FX30", "FX75", "FX85"
+};
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} text_t;
+
+typedef struct {
+    uint16_t pc;
+    uint16_t I;
+    bool I_known;
+} pending_t;
+
+typedef struct {
+    uint16_t at;
+    uint16_t start;
+    uint8_t len;
+    bool known;
+} store_t;
+
+typedef struct {
+    uint16_t entry;
+    uint16_t instructions;
+    bool returns;
+    uint16_t first_call;                //Range of this function's callees in calls
+    uint16_t num_calls;
+} function_t;
+
+//Everything one ROM needs, reused by a worker from ROM to ROM
+typedef struct {
+    uint8_t ram[RAM_SIZE];
+    uint8_t mark[RAM_SIZE];
+    uint16_t rom_end;
+    uint16_t ops[NUM_SCHIP_OPS];
+    uint16_t instructions;
+    uint16_t undefined;
+    bool leaves_rom;                    //Some path runs outside the ROM image
+
+    function_t functions[MAX_FUNCTIONS];
+    uint16_t num_functions;
+    uint16_t function_at[RAM_SIZE];     //Index + 1 of the function entered here
+    uint16_t calls[MAX_FUNCTIONS * 4];
+    uint32_t num_calls;
+    uint16_t indirect[MAX_FUNCTIONS];
+    uint16_t num_indirect;
+    store_t stores[MAX_FUNCTIONS];
+    uint16_t num_stores;
+
+    pending_t pending[MAX_PENDING];
+    uint8_t seen[RAM_SIZE];             //Reached in the current function's pass
+} analysis_t;
+
+typedef struct {
+    char path[FILENAME_MAX];
+    text_t out;
+    bool error;
+} rom_entry_t;
+
+typedef struct {
+    rom_entry_t *entries;
+    uint32_t count;
+    uint32_t next;
+    bool listing;
+    SDL_mutex *lock;
+} scan_t;
+
+static void text_printf(text_t *t, const char *format, ...)
+{
+    for (;;)
+    {
+        va_list args;
+        va_start(args, format);
+        const int n = vsnprintf(t->cap ? t->data + t->len : NULL, t->cap - t->len, format, args);
+        va_end(args);
+
+        if (n < 0)
+        {
+            return;
+        }
+        if (t->len + n < t->cap)
+        {
+            t->len += n;
+            return;
+        }
+
+        const size_t cap = (t->cap + n + 1) * 2;
+        char *data = realloc(t->data, cap);
+        if (data == NULL)
+        {
+            return;
+        }
+        t->data = data;
+        t->cap = cap;
+    }
+}
+
+static bool in_rom(const analysis_t *a, uint16_t addr)
+{
+    return addr >= START_ADDRESS && addr + 1 < a->rom_end;
+}
+
+//Queues entry for its own pass unless it is already a function
+static void add_function(analysis_t *a, uint16_t entry)
+{
+    if (a->function_at[entry] == 0 && a->num_functions < MAX_FUNCTIONS)
+    {
+        a->functions[a->num_functions] = (function_t){.entry = entry};
+        a->function_at[entry] = ++a->num_functions;
+    }
+}
+
+static void push(analysis_t *a, uint16_t *top, uint16_t pc, uint16_t I, bool I_known)
+{
+    pc &= RAM_MASK;
+    if (!a->seen[pc] && *top < MAX_PENDING)
+    {
+        a->pending[(*top)++] = (pending_t){pc, I, I_known};
+    }
+}
+
+//Counts the SUPERCHIP opcodes; the rest are CHIP-8
+static void count_variant(analysis_t *a, uint16_t opcode)
+{
+    const uint8_t NN = opcode & 0xFF;
+
+    if ((opcode & 0xFFF0) == 0x00C0)
+    {
+        a->ops[OP_00CN]++;
+    }
+    else if (opcode >= 0x00FB && opcode <= 0x00FF)
+    {
+        a->ops[OP_00FB + (opcode - 0x00FB)]++;
+    }
+    else if ((opcode & 0xF00F) == 0xD000)
+    {
+        a->ops[OP_DXY0]++;
+    }
+    else if ((opcode & 0xF000) == 0xF000 && (NN == 0x30 || NN == 0x75 || NN == 0x85))
+    {
+        a->ops[NN == 0x30 ? OP_FX30 : NN == 0x75 ? OP_FX75 : OP_FX85]++;
+    }
+}
+
+//Opcodes the core runs. handle_undef_inst only reports the rest and carries on
+//at PC + 2, so the walk does too
+static bool defined(uint16_t opcode)
+{
+    char text[32];
+
+    disassemble(opcode, text, sizeof(text));
+    return strncmp(text, "DW ", 3) != 0;
+}
+
+//Walks everything reachable from one function's entry without following its
+//calls, which become functions of their own
+static void walk_function(analysis_t *a, uint16_t index)
+{
+    function_t *f = &a->functions[index];
+    uint16_t top = 0;
+
+    memset(a->seen, 0, sizeof(a->seen));
+    f->first_call = (uint16_t)a->num_calls;
+    push(a, &top, f->entry, 0, false);
+
+    while (top > 0)
+    {
+        const pending_t p = a->pending[--top];
+        const uint16_t pc = p.pc;
+
+        if (a->seen[pc])
+        {
+            continue;
+        }
+        a->seen[pc] = 1;
+
+        if (!in_rom(a, pc))
+        {
+            a->leaves_rom = true;
+            continue;
+        }
+
+        const uint16_t opcode = (a->ram[pc] << 8) | a->ram[pc + 1];
+        const uint16_t NNN = opcode & 0x0FFF;
+        const uint8_t X = (opcode >> 8) & 0x0F;
+        const bool first = !(a->mark[pc] & MARK_CODE);
+
+        f->instructions++;
+        a->mark[pc] |= MARK_CODE;
+        a->mark[pc + 1] |= MARK_OPERAND;
+        if (first)
+        {
+            a->instructions++;
+            count_variant(a, opcode);
+        }
+
+        if (!defined(opcode))
+        {
+            a->undefined += first;
+            push(a, &top, pc + 2, p.I, p.I_known);
+            continue;
+        }
+
+        switch (opcode & 0xF000)
+        {
+            case 0x0000:
+                //00FD only prints EXIT, execution goes on past it
+                if (opcode == 0x00EE)
+                {
+                    f->returns = true;
+                }
+                else
+                {
+                    push(a, &top, pc + 2, p.I, p.I_known);
+                }
+                break;
+
+            case 0x1000:
+                push(a, &top, NNN, p.I, p.I_known);
+                break;
+
+            case 0x2000:
+            {
+                bool listed = false;
+                for (uint32_t c = f->first_call; c < a->num_calls && !listed; c++)
+                {
+                    listed = (a->calls[c] == NNN);
+                }
+                if (!listed && a->num_calls < sizeof(a->calls) / sizeof(a->calls[0]))
+                {
+                    a->calls[a->num_calls++] = NNN;
+                    f->num_calls++;
+                }
+                add_function(a, NNN);
+
+                //The callee may change I, so it is unknown after the call
+                push(a, &top, pc + 2, 0, false);
+                break;
+            }
+
+            case 0x3000:
+            case 0x4000:
+            case 0x5000:
+            case 0x9000:
+            case 0xE000:
+                push(a, &top, pc + 2, p.I, p.I_known);
+                push(a, &top, pc + 4, p.I, p.I_known);
+                break;
+
+            case 0xA000:
+                push(a, &top, pc + 2, NNN, true);
+                break;
+
+            case 0xB000:
+                if (first && a->num_indirect < MAX_FUNCTIONS)
+                {
+                    a->indirect[a->num_indirect++] = pc;
+                }
+                break;
+
+            case 0xF000:
+            {
+                const uint8_t NN = opcode & 0xFF;
+
+                if ((NN == 0x33 || NN == 0x55) && first && a->num_stores < MAX_FUNCTIONS)
+                {
+                    a->stores[a->num_stores++] = (store_t){
+                        .at = pc, .start = p.I, .len = NN == 0x33 ? 3 : X + 1, .known = p.I_known
+                    };
+                }
+
+                //Font lookups can't point at the ROM; ADD I and the load/store
+                //quirks leave I somewhere this pass doesn't follow
+                if (NN == 0x29 || NN == 0x30)
+                {
+                    push(a, &top, pc + 2, NN == 0x29 ? FONT_START : EXTENDED_FONT_START, true);
+                }
+                else if (NN == 0x1E || NN == 0x55 || NN == 0x65)
+                {
+                    push(a, &top, pc + 2, 0, false);
+                }
+                else
+                {
+                    push(a, &top, pc + 2, p.I, p.I_known);
+                }
+                break;
+            }
+
+            default:
+                push(a, &top, pc + 2, p.I, p.I_known);
+                break;
+        }
+    }
+}
+
+static void analyse(analysis_t *a, const uint8_t *rom, size_t size)
+{
+    memset(a, 0, offsetof(analysis_t, pending));
+    memcpy(&a->ram[START_ADDRESS], rom, size);
+    a->rom_end = (uint16_t)(START_ADDRESS + size);
+
+    add_function(a, START_ADDRESS);
+    for (uint16_t i = 0; i < a->num_functions; i++)
+    {
+        if (in_rom(a, a->functions[i].entry))
+        {
+            walk_function(a, i);
+        }
+        else
+        {
+            a->leaves_rom = true;
+        }
+    }
+}
+
+static bool store_hits_code(const analysis_t *a, const store_t *s, uint16_t *target)
+{
+    for (uint8_t i = 0; i < s->len; i++)
+    {
+        const uint16_t addr = (s->start + i) & RAM_MASK;
+        if (a->mark[addr])
+        {
+            *target = addr;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void write_json(const analysis_t *a, const char *path, size_t size, text_t *out)
+{
+    bool schip = false;
+    for (uint8_t i = 0; i < NUM_SCHIP_OPS; i++)
+    {
+        schip |= a->ops[i] > 0;
+    }
+
+    text_printf(out, "{\"path\": \"");
+    for (const char *c = path; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            text_printf(out, "\\%c", *c);
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            text_printf(out, "\\u%04x", *c);
+        }
+        else
+        {
+            text_printf(out, "%c", *c);
+        }
+    }
+    text_printf(out, "\", \"size\": %zu, \"variant\": \"%s\", \"ops\": {", size, schip ? "schip" : "chip8");
+    for (uint8_t i = 0; i < NUM_SCHIP_OPS; i++)
+    {
+        text_printf(out, "%s\"%s\": %u", i ? ", " : "", schip_names[i], a->ops[i]);
+    }
+
+    uint16_t code_bytes = 0;
+    for (uint16_t addr = START_ADDRESS; addr < a->rom_end; addr++)
+    {
+        code_bytes += a->mark[addr] != 0;
+    }
+    text_printf(out, "}, \"instructions\": %u, \"code_bytes\": %u, \"undefined\": %u, \"leaves_rom\": %s, \"functions\": [",
+                a->instructions, code_bytes, a->undefined, a->leaves_rom ? "true" : "false");
+
+    for (uint16_t i = 0; i < a->num_functions; i++)
+    {
+        const function_t *f = &a->functions[i];
+
+        text_printf(out, "%s{\"entry\": %u, \"instructions\": %u, \"returns\": %s, \"calls\": [",
+                    i ? ", " : "", f->entry, f->instructions, f->returns ? "true" : "false");
+        for (uint16_t c = 0; c < f->num_calls; c++)
+        {
+            text_printf(out, "%s%u", c ? ", " : "", a->calls[f->first_call + c]);
+        }
+        text_printf(out, "]}");
+    }
+
+    text_printf(out, "], \"indirect_jumps\": [");
+    for (uint16_t i = 0; i < a->num_indirect; i++)
+    {
+        text_printf(out, "%s%u", i ? ", " : "", a->indirect[i]);
+    }
+
+    uint16_t unresolved = 0, modifying = 0;
+    text_printf(out, "], \"self_modifying\": [");
+    for (uint16_t i = 0; i < a->num_stores; i++)
+    {
+        uint16_t target;
+
+        if (!a->stores[i].known)
+        {
+            unresolved++;
+        }
+        else if (store_hits_code(a, &a->stores[i], &target))
+        {
+            text_printf(out, "%s{\"at\": %u, \"target\": %u}", modifying++ ? ", " : "", a->stores[i].at, target);
+        }
+    }
+
+    const bool cacheable = a->num_indirect == 0 && a->undefined == 0 && !a->leaves_rom &&
+                           unresolved == 0 && modifying == 0;
+    text_printf(out, "], \"unresolved_stores\": %u, \"cacheable\": %s}", unresolved, cacheable ? "true" : "false");
+}
+
+//Reached instructions with their function labels; everything else as data
+static void write_listing(const analysis_t *a, const char *path, text_t *out)
+{
+    text_printf(out, "; %s\n", path);
+
+    uint16_t addr = START_ADDRESS;
+    while (addr < a->rom_end)
+    {
+        if (a->function_at[addr])
+        {
+            text_printf(out, "\n%s_%03X:\n", addr == START_ADDRESS ? "start" : "sub", addr);
+        }
+
+        if ((a->mark[addr] & MARK_CODE) && addr + 1 < a->rom_end)
+        {
+            const uint16_t opcode = (a->ram[addr] << 8) | a->ram[addr + 1];
+            char text[32];
+
+            disassemble(opcode, text, sizeof(text));
+            text_printf(out, "    %03X  %04X  %s%s\n", addr, opcode, text,
+                        (a->mark[addr] & MARK_OPERAND) ? "    ; overlaps the previous instruction" : "");
+            addr += 2;
+            continue;
+        }
+
+        //A run of data up to the next instruction or label, 8 bytes a line
+        text_printf(out, "    %03X        DB", addr);
+        for (uint8_t n = 0; n < 8 && addr < a->rom_end; n++, addr++)
+        {
+            if (n > 0 && ((a->mark[addr] & MARK_CODE) || a->function_at[addr]))
+            {
+                break;
+            }
+            text_printf(out, " 0x%02X", a->ram[addr]);
+        }
+        text_printf(out, "\n");
+    }
+}
+
+static bool scan_rom(analysis_t *a, rom_entry_t *entry, bool listing)
+{
+    FILE *file = fopen(entry->path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file: %s\n", entry->path);
+        return false;
+    }
+
+    uint8_t rom[RAM_SIZE - START_ADDRESS + 1];
+    const size_t size = fread(rom, 1, sizeof(rom), file);
+    fclose(file);
+
+    if (size > RAM_SIZE - START_ADDRESS)
+    {
+        fprintf(stderr, "Error %s too big, available size up to 3584 bytes\n", entry->path);
+        return false;
+    }
+
+    analyse(a, rom, size);
+    if (listing)
+    {
+        write_listing(a, entry->path, &entry->out);
+    }
+    else
+    {
+        write_json(a, entry->path, size, &entry->out);
+    }
+
+    return true;
+}
+
+static int worker(void *data)
+{
+    scan_t *scan = data;
+    analysis_t *a = malloc(sizeof(analysis_t));
+
+    if (a == NULL)
+    {
+        fprintf(stderr, "Error allocating analysis state\n");
+        return 1;
+    }
+
+    for (;;)
+    {
+        SDL_LockMutex(scan->lock);
+        const uint32_t index = scan->next++;
+        SDL_UnlockMutex(scan->lock);
+
+        if (index >= scan->count)
+        {
+            break;
+        }
+
+        scan->entries[index].error = !scan_rom(a, &scan->entries[index], scan->listing);
+    }
+
+    free(a);
+    return 0;
+}
+
+static bool rom_name(const char *name)
+{
+    static const char *const extensions[] = {".ch8", ".c8", ".sc8", ".xo8"};
+    const size_t len = strlen(name);
+
+    for (uint8_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+    {
+        const size_t ext = strlen(extensions[i]);
+        if (len > ext && strcmp(&name[len - ext], extensions[i]) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool add_entry(scan_t *scan, uint32_t *cap, const char *path)
+{
+    if (scan->count == *cap)
+    {
+        const uint32_t grown = *cap ? *cap * 2 : 256;
+        rom_entry_t *entries = realloc(scan->entries, grown * sizeof(rom_entry_t));
+        if (entries == NULL)
+        {
+            fprintf(stderr, "Error allocating ROM list\n");
+            return false;
+        }
+        scan->entries = entries;
+        *cap = grown;
+    }
+
+    rom_entry_t *entry = &scan->entries[scan->count++];
+    memset(entry, 0, sizeof(rom_entry_t));
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    return true;
+}
+
+//A directory adds the ROMs directly inside it, anything else is taken as a ROM
+static bool add_path(scan_t *scan, uint32_t *cap, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        fprintf(stderr, "Error opening file: %s\n", path);
+        return false;
+    }
+
+    if (!S_ISDIR(st.st_mode))
+    {
+        return add_entry(scan, cap, path);
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        fprintf(stderr, "Error opening directory: %s\n", path);
+        return false;
+    }
+
+    struct dirent *entry;
+    bool ok = true;
+    while (ok && (entry = readdir(dir)) != NULL)
+    {
+        if (rom_name(entry->d_name))
+        {
+            char full[FILENAME_MAX];
+            snprintf(full, sizeof(full), "%s/%s", path, entry->d_name);
+            ok = add_entry(scan, cap, full);
+        }
+    }
+    closedir(dir);
+
+    return ok;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const rom_entry_t *)a)->path, ((const rom_entry_t *)b)->path);
+}
+
+int main(int argc, char const *argv[])
+{
+    scan_t scan = {0};
+    uint32_t cap = 0;
+    bool broken = false;
+    int first = 1;
+
+    if (argc > 1 && strcmp(argv[1], "--listing") == 0)
+    {
+        scan.listing = true;
+        first = 2;
+    }
+
+    if (first >= argc)
+    {
+        fprintf(stderr, "Usage: %s [--listing] <rom-or-dir>...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = first; i < argc; i++)
+    {
+        broken |= !add_path(&scan, &cap, argv[i]);
+    }
+
+    qsort(scan.entries, scan.count, sizeof(rom_entry_t), compare_entries);
+
+    const int cpus = SDL_GetCPUCount() > 0 ? SDL_GetCPUCount() : 1;
+    const int num_threads = (cpus > 64) ? 64 : cpus;
+    SDL_Thread *pool[64];
+
+    scan.lock = SDL_CreateMutex();
+    for (int t = 0; t < num_threads; t++)
+    {
+        pool[t] = SDL_CreateThread(worker, "scan", &scan);
+    }
+    for (int t = 0; t < num_threads; t++)
+    {
+        SDL_WaitThread(pool[t], NULL);
+    }
+    SDL_DestroyMutex(scan.lock);
+
+    bool listed = false;
+    printf("%s", scan.listing ? "" : "[\n");
+    for (uint32_t i = 0; i < scan.count; i++)
+    {
+        rom_entry_t *entry = &scan.entries[i];
+
+        broken |= entry->error;
+        if (!entry->error && entry->out.data != NULL)
+        {
+            if (scan.listing)
+            {
+                printf("%s%s", listed ? "\n" : "", entry->out.data);
+            }
+            else
+            {
+                printf("%s%s", listed ? ",\n" : "", entry->out.data);
+            }
+            listed = true;
+        }
+        free(entry->out.data);
+    }
+    printf("%s", scan.listing ? "" : (listed ? "\n]\n" : "]\n"));
+
+    free(scan.entries);
+    return broken ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,686 @@
+#include "chip8.h"
+#include <SDL2/SDL.h>
+
+//Searches keypad inputs for the shortest way to reach a RAM condition:
+//
+//    chip8-search rom.ch8 [-s/-xo] --goal 0x2F0==3 [--goal ...] [options]
+//
+//Every level expands each state in the frontier with every input (no key, or
+//one key) held for --hold frames. Children are deduplicated by a hash of RAM,
+//registers and screen in a lock-free set shared by all threads. Plain
+//breadth-first keeps every new state (up to --width); --beam keeps only the
+//--width best by --score. The answer is printed as 'key' lines for a
+//regression .golden script.
+
+#define MAX_CONDITIONS 16
+#define MAX_SCORES 16
+#define MAX_INPUTS (NUM_KEYS + 1)
+#define MAX_THREADS 64
+#define MAX_DEPTH 4096
+
+typedef enum {
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE
+} search_op_t;
+
+typedef struct {
+    uint16_t addr;
+    search_op_t op;
+    uint8_t value;
+} condition_t;
+
+typedef struct {
+    uint16_t addr;
+    int32_t weight;
+} score_term_t;
+
+typedef struct {
+    uint32_t parent;                    //Index in the previous level
+    uint8_t input;
+    bool goal;
+    int64_t score;
+} candidate_t;
+
+typedef struct {
+    uint32_t parent;
+    uint8_t input;
+} trace_t;
+
+//Work-stealing range: the owner takes from the front, thieves split off the
+//back half. Both sides move it with one CAS on begin << 32 | end
+typedef struct {
+    uint64_t range;
+    uint8_t pad[56];                    //One cache line per worker
+} deque_t;
+
+typedef struct {
+    uint64_t expanded;
+    uint64_t duplicates;
+    uint8_t pad[48];
+} worker_stats_t;
+
+typedef struct search_s search_t;
+typedef void (*task_t)(search_t *s, uint32_t index, uint8_t worker);
+
+struct search_s {
+    condition_t goals[MAX_CONDITIONS];
+    uint8_t num_goals;
+    score_term_t scores[MAX_SCORES];
+    uint8_t num_scores;
+    uint16_t masks[MAX_INPUTS];         //Keypad mask of every input
+    uint8_t num_inputs;
+    uint8_t hold;
+    uint32_t width;
+    bool beam;
+
+    //Lock-free set of state hashes, 0 marks an empty slot
+    uint64_t *seen;
+    uint64_t seen_mask;
+    uint64_t seen_count;
+
+    chip8_t *states;                    //Current level
+    uint32_t num_states;
+    chip8_t *next;                      //Level being built
+    candidate_t *candidates;
+    uint32_t num_candidates;
+    trace_t *selected;                  //Candidates kept for the next level
+
+    task_t task;
+    deque_t deques[MAX_THREADS];
+    worker_stats_t stats[MAX_THREADS];
+    chip8_t scratch[MAX_THREADS];
+    uint8_t num_threads;
+};
+
+typedef struct {
+    search_t *search;
+    uint8_t worker;
+} worker_arg_t;
+
+//Word-at-a-time mix over everything that decides the future of a machine
+static uint64_t mix(uint64_t hash, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint64_t word;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        memcpy(&word, &bytes[i], 8);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15;
+        hash ^= hash >> 29;
+    }
+    for (; i < len; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001B3;
+    }
+
+    return hash;
+}
+
+static uint64_t state_hash(const chip8_t *chip8)
+{
+    uint64_t hash = 0xCBF29CE484222325;
+
+    hash = mix(hash, chip8->ram, sizeof(chip8->ram));
+    hash = mix(hash, chip8->gfx, sizeof(chip8->gfx));
+    hash = mix(hash, chip8->V, sizeof(chip8->V));
+    hash = mix(hash, chip8->stack, sizeof(chip8->stack));
+    hash = mix(hash, chip8->RPL, sizeof(chip8->RPL));
+
+    const uint64_t regs[] = {
+        chip8->I, chip8->PC, chip8->SP, chip8->delay_timer, chip8->sound_timer,
+        chip8->timer_cycles, chip8->rng, chip8->hr.HiRes, chip8->wait_to_key
+    };
+    hash = mix(hash, regs, sizeof(regs));
+
+    return hash ? hash : 1;
+}
+
+//True if the hash was not in the set yet
+static bool seen_insert(search_t *s, uint64_t hash)
+{
+    uint64_t slot = hash & s->seen_mask;
+
+    //A probe this long means the set is full; drop the state rather than spin
+    for (uint16_t probe = 0; probe < 1024; probe++, slot = (slot + 1) & s->seen_mask)
+    {
+        uint64_t current = __atomic_load_n(&s->seen[slot], __ATOMIC_RELAXED);
+
+        if (current == hash)
+        {
+            return false;
+        }
+
+        if (current == 0)
+        {
+            if (__atomic_compare_exchange_n(&s->seen[slot], &current, hash, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                __atomic_fetch_add(&s->seen_count, 1, __ATOMIC_RELAXED);
+                return true;
+            }
+
+            if (current == hash)
+            {
+                return false;
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool compare(uint8_t a, search_op_t op, uint8_t b)
+{
+    switch (op)
+    {
+        case OP_EQ: return a == b;
+        case OP_NE: return a != b;
+        case OP_LT: return a < b;
+        case OP_LE: return a <= b;
+        case OP_GT: return a > b;
+        case OP_GE: return a >= b;
+    }
+
+    return false;
+}
+
+static bool reached(const search_t *s, const chip8_t *chip8)
+{
+    for (uint8_t i = 0; i < s->num_goals; i++)
+    {
+        const condition_t *c = &s->goals[i];
+        if (!compare(chip8->ram[c->addr], c->op, c->value))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int64_t score(const search_t *s, const chip8_t *chip8)
+{
+    int64_t total = 0;
+
+    for (uint8_t i = 0; i < s->num_scores; i++)
+    {
+        total += (int64_t)s->scores[i].weight * chip8->ram[s->scores[i].addr];
+    }
+
+    return total;
+}
+
+//Runs one input on a copy of a state; false if the ROM halted
+static bool step(const search_t *s, const chip8_t *from, uint8_t input, chip8_t *out)
+{
+    *out = *from;
+
+    for (uint8_t i = 0; i < NUM_KEYS; i++)
+    {
+        out->keyboard[i] = (s->masks[input] >> i) & 1;
+    }
+
+    for (uint8_t f = 0; f < s->hold && out->state == RUNNING; f++)
+    {
+        run_frame(out);
+    }
+
+    return out->state == RUNNING;
+}
+
+static void expand(search_t *s, uint32_t index, uint8_t worker)
+{
+    chip8_t *child = &s->scratch[worker];
+    worker_stats_t *stats = &s->stats[worker];
+
+    for (uint8_t input = 0; input < s->num_inputs; input++)
+    {
+        if (!step(s, &s->states[index], input, child))
+        {
+            continue;
+        }
+        stats->expanded++;
+
+        if (!seen_insert(s, state_hash(child)))
+        {
+            stats->duplicates++;
+            continue;
+        }
+
+        const uint32_t slot = __atomic_fetch_add(&s->num_candidates, 1, __ATOMIC_RELAXED);
+        s->candidates[slot] = (candidate_t){
+            .parent = index,
+            .input = input,
+            .goal = reached(s, child),
+            .score = score(s, child)
+        };
+    }
+}
+
+//Rebuilds a kept child from its parent instead of storing every child
+static void materialize(search_t *s, uint32_t index, uint8_t worker)
+{
+    (void)worker;
+    step(s, &s->states[s->selected[index].parent], s->selected[index].input, &s->next[index]);
+}
+
+static bool take(deque_t *d, uint32_t *index)
+{
+    uint64_t range = __atomic_load_n(&d->range, __ATOMIC_ACQUIRE);
+
+    for (;;)
+    {
+        const uint32_t begin = range >> 32;
+        const uint32_t end = (uint32_t)range;
+
+        if (begin >= end)
+        {
+            return false;
+        }
+
+        if (__atomic_compare_exchange_n(&d->range, &range, ((uint64_t)(begin + 1) << 32) | end, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            *index = begin;
+            return true;
+        }
+    }
+}
+
+//Moves the back half of victim's range into own, which is empty
+static bool steal(deque_t *victim, deque_t *own)
+{
+    uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+
+    for (;;)
+    {
+        const uint32_t begin = range >> 32;
+        const uint32_t end = (uint32_t)range;
+        const uint32_t mid = begin + (end - begin) / 2;
+
+        if (begin >= end)
+        {
+            return false;
+        }
+
+        if (__atomic_compare_exchange_n(&victim->range, &range, ((uint64_t)begin << 32) | mid, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            __atomic_store_n(&own->range, ((uint64_t)mid << 32) | end, __ATOMIC_RELEASE);
+            return true;
+        }
+    }
+}
+
+static int worker(void *data)
+{
+    const worker_arg_t *arg = data;
+    search_t *s = arg->search;
+    const uint8_t self = arg->worker;
+    deque_t *own = &s->deques[self];
+    uint32_t index;
+
+    for (;;)
+    {
+        while (take(own, &index))
+        {
+            s->task(s, index, self);
+        }
+
+        bool stolen = false;
+        for (uint8_t i = 1; i < s->num_threads && !stolen; i++)
+        {
+            stolen = steal(&s->deques[(self + i) % s->num_threads], own);
+        }
+
+        if (!stolen)
+        {
+            return 0;
+        }
+    }
+}
+
+//Runs task over [0, count) on every thread, starting from even slices
+static void parallel_for(search_t *s, task_t task, uint32_t count)
+{
+    static worker_arg_t args[MAX_THREADS];
+    SDL_Thread *pool[MAX_THREADS];
+
+    s->task = task;
+    for (uint8_t t = 0; t < s->num_threads; t++)
+    {
+        const uint32_t begin = (uint64_t)count * t / s->num_threads;
+        const uint32_t end = (uint64_t)count * (t + 1) / s->num_threads;
+
+        s->deques[t].range = ((uint64_t)begin << 32) | end;
+        args[t] = (worker_arg_t){.search = s, .worker = t};
+    }
+
+    for (uint8_t t = 1; t < s->num_threads; t++)
+    {
+        pool[t] = SDL_CreateThread(worker, "search", &args[t]);
+    }
+    worker(&args[0]);
+    for (uint8_t t = 1; t < s->num_threads; t++)
+    {
+        SDL_WaitThread(pool[t], NULL);
+    }
+}
+
+//Beam: best score first. Ties, and plain breadth-first, keep expansion order
+static int compare_candidates(const void *a, const void *b)
+{
+    const candidate_t *x = a;
+    const candidate_t *y = b;
+
+    if (x->score != y->score)
+    {
+        return x->score > y->score ? -1 : 1;
+    }
+    if (x->parent != y->parent)
+    {
+        return x->parent < y->parent ? -1 : 1;
+    }
+    return (int)x->input - (int)y->input;
+}
+
+static bool parse_condition(const char *text, condition_t *c)
+{
+    static const struct {
+        const char *text;
+        search_op_t op;
+    } ops[] = {
+        {"==", OP_EQ}, {"!=", OP_NE}, {"<=", OP_LE}, {">=", OP_GE}, {"<", OP_LT}, {">", OP_GT}
+    };
+    char *rest;
+    const unsigned long addr = strtoul(text, &rest, 0);
+
+    if (rest == text || addr >= RAM_SIZE)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        const size_t len = strlen(ops[i].text);
+        if (strncmp(rest, ops[i].text, len) == 0)
+        {
+            char *end;
+            const unsigned long value = strtoul(rest + len, &end, 0);
+
+            c->addr = (uint16_t)addr;
+            c->op = ops[i].op;
+            c->value = (uint8_t)value;
+            return end != rest + len && *end == '\0' && value <= 0xFF;
+        }
+    }
+
+    return false;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s <path-to-rom_file.ch8> [-s/-xo] --goal <addr><op><value> [options]\n", name);
+    fprintf(stderr, "  --goal <cond>         RAM condition to reach, e.g. 0x2F0>=10; several must all hold\n");
+    fprintf(stderr, "  --score <addr>[:<w>]  Beam score term, w * RAM[addr] (w defaults to 1)\n");
+    fprintf(stderr, "  --beam                Keep the --width best states per level instead of all of them\n");
+    fprintf(stderr, "  --width <n>           States kept per level (default 16384, about 12 KB each)\n");
+    fprintf(stderr, "  --depth <n>           Levels to search (default 64)\n");
+    fprintf(stderr, "  --hold <n>            Frames each input is held (default 4)\n");
+    fprintf(stderr, "  --keys <hex digits>   Keys to try besides none, e.g. 4568 (default all)\n");
+    fprintf(stderr, "  --seed <n>            RNG seed (default 1)\n");
+    fprintf(stderr, "  --table <log2>        Dedup set size (default 24, 16M states)\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char const *argv[])
+{
+    static search_t s;
+    const char *mod = "CHIP8";
+    uint32_t depth = 64;
+    uint32_t seed = 1;
+    uint8_t table_bits = 24;
+    const char *keys = "0123456789ABCDEF";
+
+    if (argc < 2)
+    {
+        usage(argv[0]);
+    }
+
+    s.hold = 4;
+    s.width = 16384;
+
+    for (int i = 2; i < argc; i++)
+    {
+        const bool has_value = (i + 1 < argc);
+
+        if (strcmp(argv[i], "--goal") == 0 && has_value && s.num_goals < MAX_CONDITIONS)
+        {
+            if (!parse_condition(argv[++i], &s.goals[s.num_goals++]))
+            {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--score") == 0 && has_value && s.num_scores < MAX_SCORES)
+        {
+            char *rest;
+            score_term_t *term = &s.scores[s.num_scores++];
+
+            term->addr = strtoul(argv[++i], &rest, 0) & RAM_MASK;
+            term->weight = (*rest == ':') ? atoi(rest + 1) : 1;
+        }
+        else if (strcmp(argv[i], "--beam") == 0)
+        {
+            s.beam = true;
+        }
+        else if (strcmp(argv[i], "--width") == 0 && has_value)
+        {
+            s.width = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--depth") == 0 && has_value)
+        {
+            depth = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--hold") == 0 && has_value)
+        {
+            s.hold = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--keys") == 0 && has_value)
+        {
+            keys = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+        {
+            seed = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--table") == 0 && has_value)
+        {
+            table_bits = atoi(argv[++i]);
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            usage(argv[0]);
+        }
+        else
+        {
+            mod = argv[i];
+        }
+    }
+
+    if (s.num_goals == 0 || s.width == 0 || s.hold == 0 || depth == 0 || depth > MAX_DEPTH ||
+        table_bits < 10 || table_bits > 32)
+    {
+        usage(argv[0]);
+    }
+
+    s.masks[s.num_inputs++] = 0;
+    for (const char *k = keys; *k != '\0'; k++)
+    {
+        const char digit[2] = {*k, '\0'};
+        char *end;
+        const unsigned long key = strtoul(digit, &end, 16);
+
+        if (*end != '\0' || s.num_inputs == MAX_INPUTS)
+        {
+            usage(argv[0]);
+        }
+        s.masks[s.num_inputs++] = 1 << key;
+    }
+
+    const int cpus = SDL_GetCPUCount() > 0 ? SDL_GetCPUCount() : 1;
+    s.num_threads = (cpus > MAX_THREADS) ? MAX_THREADS : cpus;
+    s.seen_mask = ((uint64_t)1 << table_bits) - 1;
+    s.seen = calloc(s.seen_mask + 1, sizeof(uint64_t));
+    s.states = malloc(sizeof(chip8_t));
+    trace_t **levels = calloc(depth, sizeof(trace_t *));
+
+    if (s.seen == NULL || s.states == NULL || levels == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!system_init(&s.states[0], mod) || !load_rom(&s.states[0], argv[1]))
+    {
+        exit(EXIT_FAILURE);
+    }
+    seed_rng(&s.states[0], seed);
+    s.num_states = 1;
+    seen_insert(&s, state_hash(&s.states[0]));
+
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    const uint64_t start = SDL_GetPerformanceCounter();
+    uint64_t expanded = 0;
+    uint64_t duplicates = 0;
+    int64_t found = -1;
+    uint32_t level = 0;
+
+    for (; level < depth && s.num_states > 0 && found < 0; level++)
+    {
+        s.candidates = malloc((size_t)s.num_states * s.num_inputs * sizeof(candidate_t));
+        s.num_candidates = 0;
+        if (s.candidates == NULL)
+        {
+            fprintf(stderr, "Out of memory at depth %u\n", level + 1);
+            break;
+        }
+
+        memset(s.stats, 0, sizeof(s.stats));
+        parallel_for(&s, expand, s.num_states);
+
+        for (uint8_t t = 0; t < s.num_threads; t++)
+        {
+            expanded += s.stats[t].expanded;
+            duplicates += s.stats[t].duplicates;
+        }
+
+        //Threads append in any order; sorting makes the kept set and the
+        //reported path independent of scheduling
+        if (!s.beam)
+        {
+            for (uint32_t c = 0; c < s.num_candidates; c++)
+            {
+                s.candidates[c].score = 0;
+            }
+        }
+        qsort(s.candidates, s.num_candidates, sizeof(candidate_t), compare_candidates);
+
+        const uint32_t kept = (s.num_candidates < s.width) ? s.num_candidates : s.width;
+        levels[level] = malloc((kept ? kept : 1) * sizeof(trace_t));
+        s.next = malloc((kept ? kept : 1) * sizeof(chip8_t));
+        if (levels[level] == NULL || s.next == NULL)
+        {
+            fprintf(stderr, "Out of memory at depth %u\n", level + 1);
+            free(s.candidates);
+            break;
+        }
+
+        for (uint32_t c = 0; c < s.num_candidates; c++)
+        {
+            if (s.candidates[c].goal)
+            {
+                //The goal state is always kept, as entry 0 of the level
+                levels[level][0] = (trace_t){s.candidates[c].parent, s.candidates[c].input};
+                found = 0;
+                break;
+            }
+        }
+
+        for (uint32_t c = 0; c < kept && found < 0; c++)
+        {
+            levels[level][c] = (trace_t){s.candidates[c].parent, s.candidates[c].input};
+        }
+        free(s.candidates);
+
+        const double elapsed = (double)(SDL_GetPerformanceCounter() - start) / freq;
+        printf("depth %4u: %8u kept of %8u new, %llu states, %.1f M states/min\n", level + 1, kept,
+               s.num_candidates, (unsigned long long)__atomic_load_n(&s.seen_count, __ATOMIC_RELAXED),
+               elapsed > 0 ? expanded / elapsed * 60 / 1e6 : 0.0);
+
+        if (found >= 0)
+        {
+            free(s.next);
+            break;
+        }
+
+        s.selected = levels[level];
+        parallel_for(&s, materialize, kept);
+        free(s.states);
+        s.states = s.next;
+        s.num_states = kept;
+
+        if (__atomic_load_n(&s.seen_count, __ATOMIC_RELAXED) > s.seen_mask / 4 * 3)
+        {
+            fprintf(stderr, "Dedup set nearly full, raise --table\n");
+            break;
+        }
+    }
+
+    const double elapsed = (double)(SDL_GetPerformanceCounter() - start) / freq;
+    printf("%llu states expanded, %llu duplicates, %.2f s\n", (unsigned long long)expanded,
+           (unsigned long long)duplicates, elapsed);
+
+    int status = EXIT_FAILURE;
+    if (found >= 0)
+    {
+        //Walk the parents back to the root, then print forwards as key changes
+        uint8_t *inputs = malloc(level + 1);
+        uint32_t index = 0;
+
+        for (int64_t l = level; l >= 0; l--)
+        {
+            inputs[l] = levels[l][index].input;
+            index = levels[l][index].parent;
+        }
+
+        printf("Found at depth %u (%u frames):\n", level + 1, (level + 1) * s.hold);
+        for (uint32_t l = 0; l <= level; l++)
+        {
+            if (l == 0 || s.masks[inputs[l]] != s.masks[inputs[l - 1]])
+            {
+                printf("key %u %04x\n", l * s.hold, s.masks[inputs[l]]);
+            }
+        }
+        free(inputs);
+        status = EXIT_SUCCESS;
+    }
+    else
+    {
+        printf("Not found\n");
+    }
+
+    for (uint32_t l = 0; l < depth; l++)
+    {
+        free(levels[l]);
+    }
+    free(levels);
+    free(s.states);
+    free(s.seen);
+    return status;
+}
@@ -0,0 +1,477 @@
+#define _POSIX_C_SOURCE 200809L
+#include "chip8.h"
+#include "control.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_CLIENTS 256
+#define OUT_HIGH_WATER (256 * 1024)     //Stop answering a client that isn't reading
+#define STATE_SIZE (8 + sizeof(chip8_t))
+
+static const char *const variant_mods[3] = {"CHIP8", "-s", "-xo"};
+
+//A CTL_SAVE answer has to fit in one payload
+typedef char state_fits_payload[(STATE_SIZE <= CTL_MAX_PAYLOAD) ? 1 : -1];
+
+//Buffers are fixed: a request is at most one header plus CTL_MAX_PAYLOAD, and
+//requests are only answered while out is below OUT_HIGH_WATER, so neither
+//can overflow and nothing is allocated per request
+typedef struct {
+    int fd;
+    chip8_t chip8;
+    chip8_t boot;                   //The stored ROM as loaded, what CTL_RESET restores
+    bool loaded;
+    bool booted;                    //boot matches variant
+    uint8_t variant;
+    uint32_t seed;
+    uint16_t rom_size;
+    uint8_t rom[RAM_SIZE - START_ADDRESS];
+    size_t in_len;
+    uint8_t in[CTL_HEADER_SIZE + CTL_MAX_PAYLOAD];
+    size_t out_pos;
+    size_t out_len;
+    uint8_t out[OUT_HIGH_WATER + CTL_HEADER_SIZE + CTL_MAX_PAYLOAD];
+} client_t;
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static uint32_t get_le(const uint8_t *p, uint8_t bytes)
+{
+    uint32_t value = 0;
+
+    for (uint8_t i = 0; i < bytes; i++)
+    {
+        value |= (uint32_t)p[i] << (8 * i);
+    }
+
+    return value;
+}
+
+static uint8_t *put_le(uint8_t *p, uint32_t value, uint8_t bytes)
+{
+    for (uint8_t i = 0; i < bytes; i++)
+    {
+        *p++ = (value >> (8 * i)) & 0xFF;
+    }
+
+    return p;
+}
+
+//Reloads the stored ROM into a fresh machine of the stored variant. Later
+//resets copy back only what changed since, from the kept boot machine
+static bool reload(client_t *c, uint32_t seed)
+{
+    if (c->booted)
+    {
+        system_reset(&c->chip8, &c->boot);
+    }
+    else if (system_init(&c->boot, variant_mods[c->variant]) && load_rom_buffer(&c->boot, c->rom, c->rom_size))
+    {
+        c->chip8 = c->boot;
+        c->booted = true;
+    }
+    else
+    {
+        c->loaded = false;
+        return false;
+    }
+
+    seed_rng(&c->chip8, seed);
+    c->loaded = true;
+    return true;
+}
+
+//Handles one request whose payload is complete, writing the response payload
+//to out; returns the status and sets *out_len
+static ctl_status_t handle(client_t *c, uint8_t op, const uint8_t *in, uint32_t len, uint8_t *out, uint32_t *out_len)
+{
+    chip8_t *chip8 = &c->chip8;
+    uint8_t *p = out;
+
+    *out_len = 0;
+    if (op != CTL_LOAD && op != CTL_RESTORE && !c->loaded)
+    {
+        return (op >= CTL_LOAD && op <= CTL_FRAME) ? CTL_NO_ROM : CTL_BAD_REQUEST;
+    }
+
+    switch (op)
+    {
+        case CTL_LOAD:
+            if (len < 5)
+            {
+                return CTL_BAD_REQUEST;
+            }
+            if (in[0] > 2 || len - 5 > sizeof(c->rom))
+            {
+                return CTL_FAILED;
+            }
+            c->variant = in[0];
+            c->seed = get_le(&in[1], 4);
+            c->rom_size = (uint16_t)(len - 5);
+            memcpy(c->rom, &in[5], c->rom_size);
+            c->booted = false;
+            return reload(c, c->seed) ? CTL_OK : CTL_FAILED;
+
+        case CTL_RESET:
+            if (len != 0 && len != 4)
+            {
+                return CTL_BAD_REQUEST;
+            }
+            return reload(c, len == 4 ? get_le(in, 4) : c->seed) ? CTL_OK : CTL_FAILED;
+
+        case CTL_KEYS:
+            if (len != 2)
+            {
+                return CTL_BAD_REQUEST;
+            }
+            for (uint8_t i = 0; i < NUM_KEYS; i++)
+            {
+                chip8->keyboard[i] = (get_le(in, 2) >> i) & 1;
+            }
+            return CTL_OK;
+
+        case CTL_RUN:
+        {
+            if (len != 4)
+            {
+                return CTL_BAD_REQUEST;
+            }
+            const uint32_t frames = get_le(in, 4);
+            uint32_t run = 0;
+
+            while (run < frames && chip8->state != QUIT)
+            {
+                run_frame(chip8);
+                run++;
+            }
+            p = put_le(p, run, 4);
+            *p++ = chip8->state != QUIT;
+            break;
+        }
+
+        case CTL_SAVE:
+            if (len != 0)
+            {
+                return CTL_BAD_REQUEST;
+            }
+            //Flat RAM, no pointers: the machine is its own serialisation
+            p = put_le(p, CTL_STATE_MAGIC, 4);
+            p = put_le(p, sizeof(chip8_t), 4);
+            memcpy(p, chip8, sizeof(chip8_t));
+            p += sizeof(chip8_t);
+            break;
+
+        case CTL_RESTORE:
+        {
+            if (len != STATE_SIZE || get_le(in, 4) != CTL_STATE_MAGIC || get_le(&in[4], 4) != sizeof(chip8_t))
+            {
+                return CTL_FAILED;
+            }
+            chip8_t state;
+            memcpy(&state, &in[8], sizeof(chip8_t));
+            if (state.SP >= STACK_SIZE || (state.mod.CHIP + state.mod.SUPERCHIP + state.mod.XOCHIP) != 1)
+            {
+                return CTL_FAILED;
+            }
+            *chip8 = state;
+            select_engine(chip8);
+            system_mark_dirty(chip8);
+            const uint8_t variant = chip8->mod.SUPERCHIP ? 1 : chip8->mod.XOCHIP ? 2 : 0;
+            c->booted = c->booted && variant == c->variant;
+            c->variant = variant;
+            c->loaded = true;
+            return CTL_OK;
+        }
+
+        case CTL_REGS:
+            if (len != 0)
+            {
+                return CTL_BAD_REQUEST;
+            }
+            p = put_le(p, chip8->PC, 2);
+            p = put_le(p, chip8->I, 2);
+            *p++ = chip8->SP;
+            *p++ = chip8->delay_timer;
+            *p++ = chip8->sound_timer;
+            *p++ = chip8->hr.HiRes;
+            memcpy(p, chip8->V, NUM_REGS);
+            p += NUM_REGS;
+            for (uint8_t i = 0; i < STACK_SIZE; i++)
+            {
+                p = put_le(p, chip8->stack[i], 2);
+            }
+            break;
+
+        case CTL_RAM:
+        {
+            if (len != 4 || get_le(&in[2], 2) > RAM_SIZE)
+            {
+                return CTL_BAD_REQUEST;
+            }
+            const uint16_t addr = (uint16_t)get_le(in, 2);
+            const uint16_t count = (uint16_t)get_le(&in[2], 2);
+
+            for (uint16_t i = 0; i < count; i++)
+            {
+                *p++ = ram_read(chip8, (addr + i) & RAM_MASK);
+            }
+            break;
+        }
+
+        case CTL_FRAME:
+        {
+            if (len != 0)
+            {
+                return CTL_BAD_REQUEST;
+            }
+            const bool lores = gfx_lores(chip8);
+            const uint8_t width = lores ? SCREEN_WIDTH : SCREEN_WIDTH_S;
+            const uint8_t height = lores ? SCREEN_HEIGHT : SCREEN_HEIGHT_S;
+
+            *p++ = width;
+            *p++ = height;
+            for (uint16_t i = 0; i < width * height; i++)
+            {
+                *p++ = chip8->gfx[i] != 0;
+            }
+            break;
+        }
+
+        default:
+            return CTL_BAD_REQUEST;
+    }
+
+    *out_len = (uint32_t)(p - out);
+    return CTL_OK;
+}
+
+//Answers every complete request in the input buffer while there is room for
+//the answers. False on a framing error
+static bool process(client_t *c)
+{
+    size_t pos = 0;
+
+    while (c->out_len < OUT_HIGH_WATER && c->in_len - pos >= CTL_HEADER_SIZE)
+    {
+        const uint8_t *request = &c->in[pos];
+        const uint32_t len = get_le(&request[1], 4);
+
+        if (len > CTL_MAX_PAYLOAD)
+        {
+            fprintf(stderr, "Client sent a %u byte request, closing it\n", len);
+            return false;
+        }
+        if (c->in_len - pos < CTL_HEADER_SIZE + len)
+        {
+            break;
+        }
+
+        uint8_t *response = &c->out[c->out_len];
+        uint32_t out_len;
+
+        response[0] = handle(c, request[0], &request[CTL_HEADER_SIZE], len, &response[CTL_HEADER_SIZE], &out_len);
+        put_le(&response[1], out_len, 4);
+        c->out_len += CTL_HEADER_SIZE + out_len;
+        pos += CTL_HEADER_SIZE + len;
+    }
+
+    memmove(c->in, &c->in[pos], c->in_len - pos);
+    c->in_len -= pos;
+    return true;
+}
+
+//Sends as much as the socket takes. False if the client is gone
+static bool flush(client_t *c)
+{
+    while (c->out_pos < c->out_len)
+    {
+        const ssize_t sent = write(c->fd, &c->out[c->out_pos], c->out_len - c->out_pos);
+        if (sent < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        c->out_pos += (size_t)sent;
+    }
+
+    c->out_pos = 0;
+    c->out_len = 0;
+    return true;
+}
+
+//Reads whatever arrived, then answers and sends. False if the client is gone
+static bool service(client_t *c, short revents)
+{
+    if ((revents & POLLIN) && c->in_len < sizeof(c->in))
+    {
+        const ssize_t got = read(c->fd, &c->in[c->in_len], sizeof(c->in) - c->in_len);
+        if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            return false;
+        }
+        if (got > 0)
+        {
+            c->in_len += (size_t)got;
+        }
+    }
+    else if (revents & (POLLERR | POLLHUP | POLLNVAL))
+    {
+        return false;
+    }
+
+    //Answered requests free room in out, which may let more through
+    do
+    {
+        if (!process(c) || !flush(c))
+        {
+            return false;
+        }
+    } while (c->out_len == 0 && c->in_len >= CTL_HEADER_SIZE &&
+             c->in_len >= CTL_HEADER_SIZE + get_le(&c->in[1], 4));
+
+    return true;
+}
+
+static int listen_on(const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error creating socket\n");
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0)
+    {
+        fprintf(stderr, "Error listening on %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <socket-path>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    const int listener = listen_on(argv[1]);
+    if (listener < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    static client_t *clients[MAX_CLIENTS];
+    static struct pollfd fds[MAX_CLIENTS + 1];
+    uint16_t count = 0;
+
+    while (!stop)
+    {
+        fds[0].fd = listener;
+        fds[0].events = (count < MAX_CLIENTS) ? POLLIN : 0;
+        for (uint16_t i = 0; i < count; i++)
+        {
+            fds[i + 1].fd = clients[i]->fd;
+            fds[i + 1].events = (clients[i]->out_len < OUT_HIGH_WATER ? POLLIN : 0) |
+                                (clients[i]->out_len > 0 ? POLLOUT : 0);
+            fds[i + 1].revents = 0;
+        }
+
+        if (poll(fds, count + 1, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "Error polling sockets\n");
+            break;
+        }
+
+        //Clients first, so the ones accepted below aren't looked at with stale revents
+        for (uint16_t i = count; i-- > 0;)
+        {
+            if (fds[i + 1].revents != 0 && !service(clients[i], fds[i + 1].revents))
+            {
+                close(clients[i]->fd);
+                free(clients[i]);
+                clients[i] = clients[--count];
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd;
+            while (count < MAX_CLIENTS && (fd = accept(listener, NULL, NULL)) >= 0)
+            {
+                client_t *c = calloc(1, sizeof(client_t));
+                if (c == NULL)
+                {
+                    close(fd);
+                    break;
+                }
+
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                c->fd = fd;
+                clients[count++] = c;
+            }
+        }
+    }
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        close(clients[i]->fd);
+        free(clients[i]);
+    }
+    close(listener);
+    unlink(argv[1]);
+
+    return 0;
+}
+
+#else
+
+int main(int argc, char const *argv[])
+{
+    (void)argc;
+    fprintf(stderr, "%s: Unix-domain control sockets are not supported on this platform\n", argv[0]);
+    return EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,186 @@
+#define _POSIX_C_SOURCE 200809L
+#include "shm.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+chip8_shm_t *shm_export_open(const char *name)
+{
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error creating shared memory: %s\n", name);
+        return NULL;
+    }
+
+    if (ftruncate(fd, sizeof(chip8_shm_t)) != 0)
+    {
+        fprintf(stderr, "Error sizing shared memory: %s\n", name);
+        close(fd);
+        return NULL;
+    }
+
+    chip8_shm_t *shm = mmap(NULL, sizeof(chip8_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+    {
+        fprintf(stderr, "Error mapping shared memory: %s\n", name);
+        return NULL;
+    }
+
+    memset(shm, 0, sizeof(chip8_shm_t));
+    shm->version = SHM_VERSION;
+    shm->size = sizeof(chip8_shm_t);
+    __atomic_store_n(&shm->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+    return shm;
+}
+
+void shm_export_publish(chip8_shm_t *shm, const chip8_t *chip8, uint64_t frame)
+{
+    const uint32_t seq = shm->seq;
+    chip8_snapshot_t *snap = &shm->snap;
+
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    snap->mod = chip8->mod;
+    snap->hr = chip8->hr;
+    snap->PC = chip8->PC;
+    snap->I = chip8->I;
+    snap->SP = chip8->SP;
+    snap->delay_timer = chip8->delay_timer;
+    snap->sound_timer = chip8->sound_timer;
+    memcpy(snap->V, chip8->V, sizeof(snap->V));
+    memcpy(snap->stack, chip8->stack, sizeof(snap->stack));
+    memcpy(snap->keyboard, chip8->keyboard, sizeof(snap->keyboard));
+    memcpy(snap->ram, chip8->ram, sizeof(snap->ram));
+    gfx_output(chip8, snap->gfx);
+    shm->frame = frame;
+
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void shm_export_stats(chip8_shm_t *shm, uint64_t drawn, uint64_t presented)
+{
+    __atomic_store_n(&shm->drawn, drawn, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->presented, presented, __ATOMIC_RELAXED);
+}
+
+void shm_export_close(chip8_shm_t *shm, const char *name)
+{
+    munmap(shm, sizeof(chip8_shm_t));
+    shm_unlink(name);
+}
+
+const chip8_shm_t *shm_reader_open(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error opening shared memory: %s\n", name);
+        return NULL;
+    }
+
+    const chip8_shm_t *shm = mmap(NULL, sizeof(chip8_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+    {
+        fprintf(stderr, "Error mapping shared memory: %s\n", name);
+        return NULL;
+    }
+
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC ||
+        shm->version != SHM_VERSION || shm->size != sizeof(chip8_shm_t))
+    {
+        fprintf(stderr, "Shared memory %s was written by an incompatible emulator\n", name);
+        munmap((void *)shm, sizeof(chip8_shm_t));
+        return NULL;
+    }
+
+    return shm;
+}
+
+bool shm_reader_snapshot(const chip8_shm_t *shm, chip8_snapshot_t *snap, uint64_t *frame)
+{
+    //The emulator publishes once per frame, so a handful of retries is plenty
+    for (uint16_t attempt = 0; attempt < 1000; attempt++)
+    {
+        const uint32_t before = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+        {
+            continue;
+        }
+
+        memcpy(snap, &shm->snap, sizeof(chip8_snapshot_t));
+        if (frame != NULL)
+        {
+            *frame = shm->frame;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == before)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void shm_reader_close(const chip8_shm_t *shm)
+{
+    munmap((void *)shm, sizeof(chip8_shm_t));
+}
+
+#else
+
+chip8_shm_t *shm_export_open(const char *name)
+{
+    fprintf(stderr, "Shared memory export is not supported on this platform: %s\n", name);
+    return NULL;
+}
+
+void shm_export_publish(chip8_shm_t *shm, const chip8_t *chip8, uint64_t frame)
+{
+    (void)shm;
+    (void)chip8;
+    (void)frame;
+}
+
+void shm_export_stats(chip8_shm_t *shm, uint64_t drawn, uint64_t presented)
+{
+    (void)shm;
+    (void)drawn;
+    (void)presented;
+}
+
+void shm_export_close(chip8_shm_t *shm, const char *name)
+{
+    (void)shm;
+    (void)name;
+}
+
+const chip8_shm_t *shm_reader_open(const char *name)
+{
+    fprintf(stderr, "Shared memory export is not supported on this platform: %s\n", name);
+    return NULL;
+}
+
+bool shm_reader_snapshot(const chip8_shm_t *shm, chip8_snapshot_t *snap, uint64_t *frame)
+{
+    (void)shm;
+    (void)snap;
+    (void)frame;
+    return false;
+}
+
+void shm_reader_close(const chip8_shm_t *shm)
+{
+    (void)shm;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "chip8.h"
+
+#define SHM_MAGIC 0x38504843            //"CHP8"
+#define SHM_VERSION 2
+
+//Plain copy of everything an external tool may want to look at
+typedef struct {
+    chip8_mods_t mod;
+    chip8_hires_t hr;
+    uint16_t PC;
+    uint16_t I;
+    uint8_t SP;
+    uint8_t V[NUM_REGS];
+    uint16_t stack[STACK_SIZE];
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    bool keyboard[NUM_KEYS];
+    uint8_t ram[RAM_SIZE];
+    uint8_t gfx[SCREEN_WIDTH_S * SCREEN_HEIGHT_S];
+} chip8_snapshot_t;
+
+//Layout of the shared segment. seq is a seqlock: odd while the emulator is
+//copying a frame in, so readers retry instead of the writer ever waiting.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t seq;
+    uint64_t frame;
+    uint64_t drawn;                     //Screens the emulator finished (host stats,
+    uint64_t presented;                 //updated outside the seqlock)
+    chip8_snapshot_t snap;
+} chip8_shm_t;
+
+//Writer side, used by the emulator
+chip8_shm_t *shm_export_open(const char *name);
+void shm_export_publish(chip8_shm_t *shm, const chip8_t *chip8, uint64_t frame);
+void shm_export_stats(chip8_shm_t *shm, uint64_t drawn, uint64_t presented);
+void shm_export_close(chip8_shm_t *shm, const char *name);
+
+//Reader side, used by external tools
+const chip8_shm_t *shm_reader_open(const char *name);
+bool shm_reader_snapshot(const chip8_shm_t *shm, chip8_snapshot_t *snap, uint64_t *frame);
+void shm_reader_close(const chip8_shm_t *shm);
+
+#endif
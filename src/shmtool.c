@@ -0,0 +1,124 @@
+#define _POSIX_C_SOURCE 200809L
+#include "shm.h"
+
+static void print_regs(const chip8_shm_t *shm, const chip8_snapshot_t *snap, uint64_t frame)
+{
+    const uint64_t drawn = __atomic_load_n(&shm->drawn, __ATOMIC_RELAXED);
+    const uint64_t presented = __atomic_load_n(&shm->presented, __ATOMIC_RELAXED);
+
+    printf("Frame: %llu\n", (unsigned long long)frame);
+    if (drawn > 0)
+    {
+        printf("Presented: %llu of %llu screens (%.1f%% skipped)\n", (unsigned long long)presented,
+               (unsigned long long)drawn, 100.0 * (drawn - presented) / drawn);
+    }
+    printf("PC: %04X  I: %04X  SP: %02X  DT: %02X  ST: %02X  %s\n",
+           snap->PC, snap->I, snap->SP, snap->delay_timer, snap->sound_timer,
+           snap->hr.HiRes ? "HiRes" : "LowRes");
+
+    for (uint8_t i = 0; i < NUM_REGS; i++)
+    {
+        printf("V%X: %02X%s", i, snap->V[i], (i % 8 == 7) ? "\n" : "  ");
+    }
+
+    printf("Stack:");
+    for (uint8_t i = 1; i <= snap->SP && i < STACK_SIZE; i++)
+    {
+        printf(" %04X", snap->stack[i]);
+    }
+    printf("\n");
+}
+
+static void print_screen(const chip8_snapshot_t *snap)
+{
+    uint8_t screen_width = (snap->mod.CHIP) ? SCREEN_WIDTH : SCREEN_WIDTH_S;
+    uint8_t screen_height = (snap->mod.CHIP) ? SCREEN_HEIGHT : SCREEN_HEIGHT_S;
+
+    for (uint8_t y = 0; y < screen_height; y++)
+    {
+        for (uint8_t x = 0; x < screen_width; x++)
+        {
+            putchar(snap->gfx[y * screen_width + x] ? '#' : '.');
+        }
+        putchar('\n');
+    }
+}
+
+static void print_ram(const chip8_snapshot_t *snap, uint16_t addr, uint16_t len)
+{
+    for (uint16_t i = 0; i < len && addr + i < RAM_SIZE; i++)
+    {
+        if (i % 16 == 0)
+        {
+            printf("%s%03X:", i ? "\n" : "", addr + i);
+        }
+        printf(" %02X", snap->ram[addr + i]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <shm-name> [regs | screen | ram <addr> <len> | watch]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *cmd = (argc >= 3) ? argv[2] : "regs";
+    const chip8_shm_t *shm = shm_reader_open(argv[1]);
+    if (shm == NULL)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    static chip8_snapshot_t snap;
+    uint64_t frame = 0;
+
+    if (strcmp(cmd, "watch") == 0)
+    {
+        uint64_t last = UINT64_MAX;
+        const struct timespec poll = {.tv_sec = 0, .tv_nsec = 4000000};
+
+        for (;;)
+        {
+            if (shm_reader_snapshot(shm, &snap, &frame) && frame != last)
+            {
+                printf("\033[H\033[2J");
+                print_regs(shm, &snap, frame);
+                fflush(stdout);
+                last = frame;
+            }
+            nanosleep(&poll, NULL);
+        }
+    }
+
+    if (!shm_reader_snapshot(shm, &snap, &frame))
+    {
+        fprintf(stderr, "Could not get a consistent snapshot\n");
+        shm_reader_close(shm);
+        exit(EXIT_FAILURE);
+    }
+
+    if (strcmp(cmd, "regs") == 0)
+    {
+        print_regs(shm, &snap, frame);
+    }
+    else if (strcmp(cmd, "screen") == 0)
+    {
+        print_screen(&snap);
+    }
+    else if (strcmp(cmd, "ram") == 0 && argc == 5)
+    {
+        print_ram(&snap, strtoul(argv[3], NULL, 0), strtoul(argv[4], NULL, 0));
+    }
+    else
+    {
+        fprintf(stderr, "Unknown command: %s\n", cmd);
+        shm_reader_close(shm);
+        exit(EXIT_FAILURE);
+    }
+
+    shm_reader_close(shm);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include "chip8.h"
+
+//Shared by instruction_execution and the lockstep lanes, so both draw
+//DXYN rows the same way
+
+//Sprite byte to eight pixels, one byte each, leftmost first
+#define SPRITE_ROW(b) {((b) >> 7) & 1, ((b) >> 6) & 1, ((b) >> 5) & 1, ((b) >> 4) & 1, \
+                       ((b) >> 3) & 1, ((b) >> 2) & 1, ((b) >> 1) & 1, (b) & 1}
+#define SPRITE_ROWS4(b) SPRITE_ROW(b), SPRITE_ROW((b) + 1), SPRITE_ROW((b) + 2), SPRITE_ROW((b) + 3)
+#define SPRITE_ROWS16(b) SPRITE_ROWS4(b), SPRITE_ROWS4((b) + 4), SPRITE_ROWS4((b) + 8), SPRITE_ROWS4((b) + 12)
+#define SPRITE_ROWS64(b) SPRITE_ROWS16(b), SPRITE_ROWS16((b) + 16), SPRITE_ROWS16((b) + 32), SPRITE_ROWS16((b) + 48)
+
+static const uint8_t sprite_rows[256][8] __attribute__((aligned(8))) = {
+    SPRITE_ROWS64(0), SPRITE_ROWS64(64), SPRITE_ROWS64(128), SPRITE_ROWS64(192)
+};
+
+//XORs one sprite byte into a screen row. The screen is a byte per pixel, so
+//with the byte pre-expanded the eight pixels are one unaligned 64-bit load,
+//test and store. Past the right edge the sprite is clipped, or wrapped to
+//the start of the row. Returns true on a collision
+static inline bool draw_sprite_row(uint8_t *row, uint8_t x, uint8_t width, uint8_t bits, bool wrap)
+{
+    const uint8_t *sprite = sprite_rows[bits];
+    bool collision = false;
+
+    if (bits == 0)
+    {
+        return false;
+    }
+
+    if (x + 8 <= width)
+    {
+        uint64_t screen, pixels;
+
+        memcpy(&screen, &row[x], sizeof(screen));
+        memcpy(&pixels, sprite, sizeof(pixels));
+        collision = (screen & pixels) != 0;
+        screen ^= pixels;
+        memcpy(&row[x], &screen, sizeof(screen));
+        return collision;
+    }
+
+    for (uint8_t i = 0; i < 8 && (wrap || x + i < width); i++)
+    {
+        uint8_t *pixel = &row[(x + i) % width];
+
+        collision |= (*pixel & sprite[i]) != 0;
+        *pixel ^= sprite[i];
+    }
+
+    return collision;
+}
+
+#endif
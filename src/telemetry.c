@@ -0,0 +1,132 @@
+#include <string.h>
+#include "telemetry.h"
+
+static const char *const stage_names[NUM_STAGES] = {
+    "input", "batch", "draw", "present", "overshoot"
+};
+
+void telemetry_init(telemetry_t *t, uint64_t freq)
+{
+    memset(t, 0, sizeof(telemetry_t));
+    t->freq = freq;
+}
+
+static uint32_t bucket_index(uint64_t value)
+{
+    if (value < HIST_SUB)
+    {
+        return (uint32_t)value;
+    }
+
+    const uint32_t exp = 63 - __builtin_clzll(value);
+    const uint32_t sub = (value >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1);
+    return (exp - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+//Largest value that lands in the bucket
+static uint64_t bucket_value(uint32_t index)
+{
+    const uint32_t group = index / HIST_SUB;
+    if (group == 0)
+    {
+        return index;
+    }
+
+    const uint32_t shift = group - 1;
+    const uint64_t lower = (uint64_t)(HIST_SUB + index % HIST_SUB) << shift;
+    return lower + ((uint64_t)1 << shift) - 1;
+}
+
+//Called on the hot path: no locked instructions, only the owning thread writes
+void telemetry_record(telemetry_t *t, stage_t stage, uint64_t ticks)
+{
+    histogram_t *h = &t->stages[stage];
+    uint32_t *count = &h->counts[bucket_index(ticks)];
+
+    __atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->total, h->total + 1, __ATOMIC_RELAXED);
+    if (ticks > h->max)
+    {
+        __atomic_store_n(&h->max, ticks, __ATOMIC_RELAXED);
+    }
+}
+
+//Value at or below which a fraction p of the samples fall, in ticks
+uint64_t histogram_percentile(const histogram_t *h, double p)
+{
+    const uint64_t total = __atomic_load_n(&h->total, __ATOMIC_RELAXED);
+    const uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    const uint64_t target = (uint64_t)(p * total + 0.5);
+    uint64_t seen = 0;
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        if (seen >= target && seen > 0)
+        {
+            const uint64_t value = bucket_value(i);
+            return value < max ? value : max;
+        }
+    }
+
+    return max;
+}
+
+static double to_us(const telemetry_t *t, uint64_t ticks)
+{
+    return ticks * 1e6 / t->freq;
+}
+
+//One line per stage that has samples, times in microseconds
+void telemetry_print(const telemetry_t *t, FILE *out)
+{
+    fprintf(out, "%-10s %10s %10s %10s %10s\n", "stage", "count", "p50 us", "p99 us", "max us");
+
+    for (uint8_t i = 0; i < NUM_STAGES; i++)
+    {
+        const histogram_t *h = &t->stages[i];
+        const uint64_t total = __atomic_load_n(&h->total, __ATOMIC_RELAXED);
+
+        if (total == 0)
+        {
+            continue;
+        }
+
+        fprintf(out, "%-10s %10llu %10.1f %10.1f %10.1f\n", stage_names[i], (unsigned long long)total,
+                to_us(t, histogram_percentile(h, 0.50)), to_us(t, histogram_percentile(h, 0.99)),
+                to_us(t, __atomic_load_n(&h->max, __ATOMIC_RELAXED)));
+    }
+}
+
+//Replaces path as a whole, so a reader never sees a half-written file
+bool telemetry_write(const telemetry_t *t, const char *path)
+{
+    char tmp[FILENAME_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *file = fopen(tmp, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening stats file: %s\n", tmp);
+        return false;
+    }
+
+    telemetry_print(t, file);
+    fclose(file);
+
+#ifdef _WIN32
+    remove(path);
+#endif
+    if (rename(tmp, path) != 0)
+    {
+        fprintf(stderr, "Error replacing stats file: %s\n", path);
+        return false;
+    }
+
+    return true;
+}
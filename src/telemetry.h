@@ -0,0 +1,41 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#define HIST_SUB_BITS 4                 //16 buckets per power of two, ~6% resolution
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef enum {
+    STAGE_INPUT,                        //keyboard(), event polling
+    STAGE_BATCH,                        //One frame's instructions
+    STAGE_DRAW,                         //window_print
+    STAGE_PRESENT,                      //window_present
+    STAGE_OVERSHOOT,                    //How late the emulation thread woke from its sleep
+    NUM_STAGES
+} stage_t;
+
+//Log-linear histogram of performance counter ticks, HDR style: exact below
+//HIST_SUB, then HIST_SUB buckets per power of two. Each stage has a single
+//writer thread; readers may see it a sample behind, never torn
+typedef struct {
+    uint32_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} histogram_t;
+
+typedef struct {
+    histogram_t stages[NUM_STAGES];
+    uint64_t freq;                      //Ticks per second
+} telemetry_t;
+
+void telemetry_init(telemetry_t *t, uint64_t freq);
+void telemetry_record(telemetry_t *t, stage_t stage, uint64_t ticks);
+uint64_t histogram_percentile(const histogram_t *h, double p);
+void telemetry_print(const telemetry_t *t, FILE *out);
+bool telemetry_write(const telemetry_t *t, const char *path);
+
+#endif
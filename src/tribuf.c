@@ -0,0 +1,35 @@
+#include "tribuf.h"
+
+void tribuf_init(tribuf_t *tb)
+{
+    memset(tb, 0, sizeof(tribuf_t));
+    tb->back = 0;
+    tb->middle = 1;
+    tb->front = 2;
+}
+
+//Fills the writer's buffer and swaps it into the middle. An unread frame
+//already there is simply replaced
+void tribuf_publish(tribuf_t *tb, const chip8_t *chip8, uint64_t frame)
+{
+    tribuf_frame_t *out = &tb->buffers[tb->back];
+
+    memcpy(out->gfx, chip8->gfx, sizeof(out->gfx));
+    out->lores = gfx_lores(chip8);
+    out->frame = frame;
+
+    tb->back = __atomic_exchange_n(&tb->middle, tb->back | TRIBUF_DIRTY, __ATOMIC_ACQ_REL) & 3;
+    __atomic_store_n(&tb->published, tb->published + 1, __ATOMIC_RELAXED);
+}
+
+//Newest frame the writer has published since the last call, or NULL
+const tribuf_frame_t *tribuf_acquire(tribuf_t *tb)
+{
+    if (!(__atomic_load_n(&tb->middle, __ATOMIC_RELAXED) & TRIBUF_DIRTY))
+    {
+        return NULL;
+    }
+
+    tb->front = __atomic_exchange_n(&tb->middle, tb->front, __ATOMIC_ACQ_REL) & 3;
+    return &tb->buffers[tb->front];
+}
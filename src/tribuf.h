@@ -0,0 +1,29 @@
+#ifndef TRIBUF_H
+#define TRIBUF_H
+
+#include "chip8.h"
+
+#define TRIBUF_DIRTY 0x4                //Set in middle when it holds an unread frame
+
+typedef struct {
+    uint8_t gfx[SCREEN_WIDTH_S * SCREEN_HEIGHT_S];
+    bool lores;                         //gfx is a 64x32 surface, see gfx_lores
+    uint64_t frame;
+} tribuf_frame_t;
+
+//Lock-free triple buffer between the emulation thread (writer) and the render
+//thread (reader). Each side owns one buffer; they only ever swap their own
+//with the shared middle one, so neither side can block the other.
+typedef struct {
+    tribuf_frame_t buffers[3];
+    uint8_t back;                       //Writer's buffer
+    uint8_t front;                      //Reader's buffer
+    uint8_t middle;                     //Shared index, plus TRIBUF_DIRTY
+    uint64_t published;                 //Frames handed over so far
+} tribuf_t;
+
+void tribuf_init(tribuf_t *tb);
+void tribuf_publish(tribuf_t *tb, const chip8_t *chip8, uint64_t frame);
+const tribuf_frame_t *tribuf_acquire(tribuf_t *tb);
+
+#endif
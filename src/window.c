@@ -1,28 +1,18 @@
 #include "window.h"
+#include "perfcount.h"
+#include "heatmap.h"
 
-void update_timer(chip8_t *chip8, sdl_t *sdl)
+//The timers themselves run on the emulated clock; this only follows the beeper
+void update_audio(const chip8_t *chip8, sdl_t *sdl)
 {
-    if (chip8->delay_timer > 0)
-    {
-        chip8->delay_timer--;
-        // printf("Delay Timer: %d\n", chip8->delay_timer);     //For debug purpose
-    }
-
-    if (chip8->sound_timer > 0)
-    {
-        chip8->sound_timer--;
-        SDL_PauseAudioDevice(sdl->device, 0);
-        // printf("Sound Timer: %d\n", chip8->sound_timer);     //For debug purpose
-    }
-    else
-    {
-        SDL_PauseAudioDevice(sdl->device, 1);
-    }
+    SDL_PauseAudioDevice(sdl->device, chip8->sound_timer > 0 ? 0 : 1);
 }
 
 void callback(void *userdata, uint8_t *stream, int len)
 {
     (void)userdata;
+    PERF_SAMPLE(perf);
+    PERF_BEGIN(perf);
 
     uint8_t *audio_data = stream;
     uint16_t sample_index = 0;
@@ -33,6 +23,8 @@ void callback(void *userdata, uint8_t *stream, int len)
     {
         audio_data[i] = ((sample_index++ / half_period) % 2) ? 3000 : -3000;
     }
+
+    PERF_END(REGION_AUDIO, perf);
 }
 
 void audio_init(sdl_t *sdl)
@@ -56,11 +48,14 @@ void audio_init(sdl_t *sdl)
     }
 }
 
-void window_init(sdl_t *sdl)
+void window_init(sdl_t *sdl, uint16_t width, uint16_t height)
 {
+    sdl->width = width;
+    sdl->height = height;
+
     sdl->window = SDL_CreateWindow("CHIP8 Emulator",
                                 SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                WINDOW_WIDTH, WINDOW_HEIGHT, 0);
+                                width, height, 0);
     if (sdl->window == NULL)
     {
         fprintf(stderr, "Error creating window: %s\n", SDL_GetError());
@@ -75,47 +70,150 @@ void window_init(sdl_t *sdl)
         SDL_Quit();
         exit(EXIT_FAILURE);
     }
+
+    sdl->texture = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                     SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (sdl->texture == NULL)
+    {
+        fprintf(stderr, "Error creating texture: %s\n", SDL_GetError());
+        SDL_Quit();
+        exit(EXIT_FAILURE);
+    }
 }
 
-void window_print(sdl_t *sdl, chip8_t *chip8)
+//Scales a published frame straight into the streaming texture and queues it;
+//lo-res surfaces (64x32) end up at twice the scale. window_present shows it
+void window_print(sdl_t *sdl, const uint8_t *gfx, bool lores)
 {
-    uint8_t scale = (chip8->mod.CHIP) ? SCALE : SCALE_S;
-    uint8_t screen_width = (chip8->mod.CHIP) ? SCREEN_WIDTH : SCREEN_WIDTH_S;
-    uint8_t screen_height = (chip8->mod.CHIP) ? SCREEN_HEIGHT : SCREEN_HEIGHT_S;
+    const uint16_t screen_width = lores ? SCREEN_WIDTH : SCREEN_WIDTH_S;
+    const uint16_t screen_height = lores ? SCREEN_HEIGHT : SCREEN_HEIGHT_S;
+    void *pixels;
+    int pitch;
 
-    SDL_Rect rect = {.w = scale, .h = scale};
-    
-    for (uint8_t y = 0; y < screen_height; y++)
+    if (SDL_LockTexture(sdl->texture, NULL, &pixels, &pitch) != 0)
+    {
+        fprintf(stderr, "Error locking texture: %s\n", SDL_GetError());
+        return;
+    }
+
+    scaler_render(&sdl->scaler, gfx, screen_width, screen_height, pixels, pitch, sdl->width, sdl->height);
+    SDL_UnlockTexture(sdl->texture);
+    SDL_RenderCopy(sdl->renderer, sdl->texture, NULL, NULL);
+}
+
+void window_present(sdl_t *sdl)
+{
+    SDL_RenderPresent(sdl->renderer);
+}
+
+void window_clear(sdl_t *sdl)
+{    
+    SDL_SetRenderDrawColor(sdl->renderer, 0, 0, 0, 255);
+    SDL_RenderClear(sdl->renderer);
+}
+
+#ifdef CHIP8_HEATMAP
+//A second window beside the screen, one pixel per RAM address scaled up 8x
+void heatmap_window_init(sdl_t *sdl)
+{
+    sdl->heat_window = SDL_CreateWindow("CHIP8 RAM heatmap",
+                                        SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                        HEATMAP_SIDE * 8, HEATMAP_SIDE * 8, 0);
+    if (sdl->heat_window != NULL)
+    {
+        sdl->heat_renderer = SDL_CreateRenderer(sdl->heat_window, -1, SDL_RENDERER_ACCELERATED);
+    }
+    if (sdl->heat_renderer != NULL)
+    {
+        sdl->heat_texture = SDL_CreateTexture(sdl->heat_renderer, SDL_PIXELFORMAT_ARGB8888,
+                                              SDL_TEXTUREACCESS_STREAMING, HEATMAP_SIDE, HEATMAP_SIDE);
+    }
+
+    //The overlay is optional; the counts still go to --heatmap
+    if (sdl->heat_texture == NULL)
+    {
+        fprintf(stderr, "Error creating heatmap window: %s\n", SDL_GetError());
+    }
+}
+
+void heatmap_window_print(sdl_t *sdl)
+{
+    void *pixels;
+    int pitch;
+
+    if (sdl->heat_texture == NULL || SDL_LockTexture(sdl->heat_texture, NULL, &pixels, &pitch) != 0)
+    {
+        return;
+    }
+
+    heatmap_render(pixels, pitch);
+    SDL_UnlockTexture(sdl->heat_texture);
+    SDL_RenderCopy(sdl->heat_renderer, sdl->heat_texture, NULL, NULL);
+    SDL_RenderPresent(sdl->heat_renderer);
+}
+#endif
+
+//Returns true if the machine was reset to boot, its state as loaded, by the user
+bool keyboard(chip8_t *chip8, const chip8_t *boot)
+{
+    SDL_Event event;
+    bool reset = false;
+
+    while (SDL_PollEvent(&event))
     {
-        for (uint8_t x = 0; x < screen_width; x++)
+        if (event.type == SDL_KEYDOWN)
         {
-            rect.x = x * scale;
-            rect.y = y * scale;
-            
-            uint32_t i = y * screen_width + x;
-            
-            if (chip8->gfx[i])
+            switch (event.key.keysym.sym)
             {
-                SDL_SetRenderDrawColor(sdl->renderer, 255, 255, 255, 255);
-                SDL_RenderFillRect(sdl->renderer, &rect);
+            case SDLK_ESCAPE:
+                chip8->state = QUIT;
+                break;
+
+            case SDL_QUIT:
+                chip8->state = QUIT;
+                break;
+            
+            case SDLK_SPACE:
+                if (chip8->state == PAUSED)
+                {
+                    chip8->state = RUNNING;
+                }
+                else
+                {
+                    chip8->state = PAUSED;
+                }
+                break;
 
-                //Draw pixel outline
-                // SDL_SetRenderDrawColor(sdl->renderer, 0, 0, 0, 255);
-                // SDL_RenderDrawRect(sdl->renderer, &rect);
+            case SDLK_LALT:
+                system_reset(chip8, boot);
+                seed_rng(chip8, (uint32_t)rand());
+                reset = true;
+                break;
+
+            default:
+                break;
             }
-            else
+        }
+
+        for (uint8_t i = 0; i < NUM_KEYS; i++)
+        {
+            if (event.key.keysym.sym == keyboard_map[i])
+            {
+                chip8->keyboard[i] = true;
+            }
+        }
+
+        if (event.type == SDL_KEYUP)
+        {
+            for (uint8_t i = 0; i < NUM_KEYS; i++)
             {
-                SDL_SetRenderDrawColor(sdl->renderer, 0, 0, 0, 255);
-                SDL_RenderFillRect(sdl->renderer, &rect);
+                if (event.key.keysym.sym == keyboard_map[i])
+                {
+                    chip8->keyboard[i] = false;
+                }
             }
         }
     }
-    
-    SDL_RenderPresent(sdl->renderer);
-}
 
-void window_clear(sdl_t *sdl)
-{    
-    SDL_SetRenderDrawColor(sdl->renderer, 0, 0, 0, 255);
-    SDL_RenderClear(sdl->renderer);
-}
\ No newline at end of file
+    return reset;
+}
@@ -1,14 +1,55 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
 #include "chip8.h"
+#include "scaler.h"
+#include <SDL2/SDL.h>
+
+static const uint8_t keyboard_map[NUM_KEYS] = {
+    SDLK_x, // 0
+    SDLK_1, // 1
+    SDLK_2, // 2
+    SDLK_3, // 3
+    SDLK_q, // 4
+    SDLK_w, // 5
+    SDLK_e, // 6
+    SDLK_a, // 7
+    SDLK_s, // 8
+    SDLK_d, // 9
+    SDLK_z, // A
+    SDLK_c, // B
+    SDLK_4, // C
+    SDLK_r, // D
+    SDLK_f, // E
+    SDLK_v  // F
+};
 
 typedef struct {
     SDL_Window *window; 
     SDL_Renderer *renderer;
+    SDL_Texture *texture;           //Streaming, window sized, filled by the scaler
+    uint16_t width;
+    uint16_t height;
+    scaler_t scaler;
     SDL_AudioDeviceID device;
     SDL_AudioSpec desired, obtained;
+#ifdef CHIP8_HEATMAP
+    SDL_Window *heat_window;        //Live RAM heatmap, see heatmap.h
+    SDL_Renderer *heat_renderer;
+    SDL_Texture *heat_texture;
+#endif
 } sdl_t;
 
-void update_timer(chip8_t *chip8, sdl_t *sdl);
+void update_audio(const chip8_t *chip8, sdl_t *sdl);
 void audio_init(sdl_t *sdl);
-void window_init(sdl_t *sdl);
-void window_print(sdl_t *sdl, chip8_t *chip8);
-void window_clear(sdl_t *sdl);
\ No newline at end of file
+void window_init(sdl_t *sdl, uint16_t width, uint16_t height);
+void window_print(sdl_t *sdl, const uint8_t *gfx, bool lores);
+void window_present(sdl_t *sdl);
+void window_clear(sdl_t *sdl);
+#ifdef CHIP8_HEATMAP
+void heatmap_window_init(sdl_t *sdl);
+void heatmap_window_print(sdl_t *sdl);
+#endif
+bool keyboard(chip8_t *chip8, const chip8_t *boot);
+
+#endif